@@ -3,6 +3,7 @@
 #include <string>
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "socklib.h"
 #include "defer.h"
@@ -73,6 +74,8 @@ public:
 	int xVel, yVel, zVel;
 	void* sprite;
 
+	virtual ~GameObject() = default;
+
 	virtual void Update(float dt) {
 		x += xVel * dt;
 		y += yVel * dt;
@@ -117,7 +120,9 @@ size_t copy_to_buffer(char* buffer, T* value, size_t buffer_len) {
 }
 
 template<typename T>
-size_t read_from_buffer(char* buffer, T* out_value) {
+size_t read_from_buffer(const char* buffer, T* out_value, size_t buffer_len) {
+	// Never trust the length of data from the network.
+	if (sizeof(T) > buffer_len) return 0;
 	memcpy(out_value, buffer, sizeof(T));
 	return sizeof(T);
 }
@@ -142,15 +147,19 @@ size_t SerializeGameObjectAsBytes(const GameObject* go, char* buffer, size_t buf
 * sock.Send(buffer, nbytes_written);
 */
 
-size_t DeserializeGameObjectFromBytes(GameObject* go, char* buffer, size_t buffer_len)
+// Returns 0 if the buffer is too short to hold a whole game object.
+size_t DeserializeGameObjectFromBytes(GameObject* go, const char* buffer, size_t buffer_len)
 {
+	const size_t object_size = 6 * sizeof(int);
+	if (buffer_len < object_size) return 0;
+
 	size_t read_head = 0;
-	read_head += read_from_buffer(buffer, &go->x);
-	read_head += read_from_buffer(&buffer[read_head], &go->y);
-	read_head += read_from_buffer(&buffer[read_head], &go->z);
-	read_head += read_from_buffer(&buffer[read_head], &go->xVel);
-	read_head += read_from_buffer(&buffer[read_head], &go->yVel);
-	read_head += read_from_buffer(&buffer[read_head], &go->zVel);
+	read_head += read_from_buffer(buffer, &go->x, buffer_len);
+	read_head += read_from_buffer(&buffer[read_head], &go->y, buffer_len - read_head);
+	read_head += read_from_buffer(&buffer[read_head], &go->z, buffer_len - read_head);
+	read_head += read_from_buffer(&buffer[read_head], &go->xVel, buffer_len - read_head);
+	read_head += read_from_buffer(&buffer[read_head], &go->yVel, buffer_len - read_head);
+	read_head += read_from_buffer(&buffer[read_head], &go->zVel, buffer_len - read_head);
 	return read_head;
 }
 
@@ -260,22 +269,36 @@ int run_server() {
 					exit(1);
 				}
 			}
+			if (nbytes_recvd == 0) {
+				// The client closed the connection.
+				connection_alive = false;
+				continue;
+			}
+			if (nbytes_recvd < 0) continue;
 			// Expect data in a specific format --
 			//     First, the number of game objects
 			int num_gameobjects = 0;
-			read_from_buffer(buffer, &num_gameobjects);
+			size_t buffer_offset = read_from_buffer(buffer, &num_gameobjects, nbytes_recvd);
+			// The count comes off the wire, so check it against what
+			// actually arrived before trusting it.
+			size_t max_gameobjects = (nbytes_recvd - buffer_offset) / (6 * sizeof(int));
+			if (buffer_offset == 0 || num_gameobjects < 0 || (size_t)num_gameobjects > max_gameobjects) {
+				std::cerr << "Dropping malformed message (" << nbytes_recvd << " bytes).\n";
+				continue;
+			}
 			std::cout << "Reading " << num_gameobjects << " objects.\n";
+			for (GameObject* go : game_objects) delete go;
 			game_objects.clear();
 			game_objects.reserve(num_gameobjects);
-			size_t buffer_offset = 0;
 
 			for (int i = 0; i < num_gameobjects; i++) {
 				GameObject* go = new GameObject;
 				buffer_offset += DeserializeGameObjectFromBytes(go,
-					&buffer[buffer_offset], sizeof(buffer) - buffer_offset);
+					&buffer[buffer_offset], nbytes_recvd - buffer_offset);
 				game_objects.push_back(go);
 			}
 		}
+		for (GameObject* go : game_objects) delete go;
 	}
 
 	// Keep a list of game objects
@@ -316,8 +339,8 @@ size_t SerializePawn(const Pawn* p, char* buffer, size_t cap) {
 	return copy_to_buffer(buffer, &p->mood, cap);
 }
 
-size_t DeserializePawn(const Pawn* p, char* buffer, size_t cap) {
-	return read_from_buffer(buffer, &p->mood);
+size_t DeserializePawn(Pawn* p, char* buffer, size_t cap) {
+	return read_from_buffer(buffer, &p->mood, cap);
 }
 
 int main(int argc, char *argv[]) {
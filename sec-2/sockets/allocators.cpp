@@ -4,7 +4,20 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#endif
 
 #include "allocators.h"
 
@@ -12,6 +25,7 @@ static bool allocs_should_print = true;
 
 static unsigned int base_alloc_counter = 0;
 static unsigned int *p_alloc_counter = &base_alloc_counter;
+static AllocationContext *p_current_context = nullptr;
 
 void set_allocs_should_print(bool should_print)
 {
@@ -66,30 +80,440 @@ bool operator!=(const Mallocator <T>&, const Mallocator <U>&) { return false; }
 
 static std::unordered_map<const void*, std::size_t, std::hash<const void *>, std::equal_to<const void*>, Mallocator<std::pair<const void* const, std::size_t>>> allocs;
 
-void * operator new(std::size_t n)
+// ==== Allocation profiler ====
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PROFILER_NOINLINE __declspec(noinline)
+#define PROFILER_RETURN_ADDRESS() _ReturnAddress()
+#else
+#define PROFILER_NOINLINE __attribute__((noinline))
+#define PROFILER_RETURN_ADDRESS() __builtin_return_address(0)
+#endif
+
+static const int kMaxFrames = 24;
+// Upper bound on the profiler's own frames at the top of a captured
+// stack; see first_caller_frame().
+static const int kSkipFrames = 4;
+static const int kSizeBuckets = 40;
+
+static unsigned int alloc_sample_rate = 0;
+static unsigned int alloc_sample_countdown = 0;
+// Set while the profiler itself is running, so that allocations it
+// makes (hash map nodes, report strings) aren't sampled.
+static bool profiler_busy = false;
+
+// Bucket i holds sizes in (2^(i-1), 2^i]; bucket 0 holds 0 and 1.
+static int size_bucket(std::size_t n)
+{
+    int bucket = 0;
+    while (bucket < kSizeBuckets - 1 && ((std::size_t)1 << bucket) < n)
+        bucket++;
+    return bucket;
+}
+
+struct SizeHistogram
+{
+    std::size_t count = 0;
+    std::size_t bytes = 0;
+    std::size_t buckets[kSizeBuckets] = { 0 };
+
+    void add(std::size_t n)
+    {
+        count++;
+        bytes += n;
+        buckets[size_bucket(n)]++;
+    }
+};
+
+struct CallSite
+{
+    char context[32];
+    int num_frames;
+    void* frames[kMaxFrames];
+
+    bool operator==(const CallSite& other) const
+    {
+        return num_frames == other.num_frames
+            && strcmp(context, other.context) == 0
+            && memcmp(frames, other.frames, num_frames * sizeof(void*)) == 0;
+    }
+};
+
+struct CallSiteHash
+{
+    std::size_t operator()(const CallSite& site) const
+    {
+        // FNV-1a over the context name and return addresses.
+        std::size_t h = 14695981039346656037ull;
+        for (const char* c = site.context; *c != '\0'; c++)
+            h = (h ^ (unsigned char)*c) * 1099511628211ull;
+        for (int i = 0; i < site.num_frames; i++)
+            h = (h ^ (std::size_t)site.frames[i]) * 1099511628211ull;
+        return h;
+    }
+};
+
+typedef std::basic_string<char, std::char_traits<char>, Mallocator<char>> MallocString;
+
+struct MallocStringHash
+{
+    std::size_t operator()(const MallocString& s) const
+    {
+        return std::hash<std::string_view>()(std::string_view(s.data(), s.size()));
+    }
+};
+
+template<class K, class V, class H = std::hash<K>>
+using MallocMap = std::unordered_map<K, V, H, std::equal_to<K>, Mallocator<std::pair<const K, V>>>;
+
+static MallocMap<CallSite, SizeHistogram, CallSiteHash> call_site_profile;
+static MallocMap<MallocString, SizeHistogram, MallocStringHash> context_profile;
+
+static const char* current_context_name()
+{
+    if (p_current_context == nullptr) return "(global)";
+    return p_current_context->_name;
+}
+
+static int capture_stack(void** frames, int max_frames)
+{
+#ifdef _WIN32
+    return CaptureStackBackTrace(0, max_frames, frames, nullptr);
+#else
+    return backtrace(frames, max_frames);
+#endif
+}
+
+// `caller` is the return address tracked_alloc() was called with, i.e.
+// a point inside operator new (or inside the user's code, when the
+// compiler turned operator new into a jump). Starting the stack there
+// drops the profiler's own frames however much of it got inlined.
+static int first_caller_frame(void** frames, int num_frames, void* caller)
+{
+    for (int i = 0; i < num_frames && i <= kSkipFrames; i++)
+    {
+        if (frames[i] == caller) return i;
+    }
+    return std::min(num_frames, kSkipFrames);
+}
+
+static void record_alloc_sample(std::size_t n, void* caller)
 {
-  void *p = std::malloc(n);
+    profiler_busy = true;
+
+    void* raw_frames[kMaxFrames + kSkipFrames];
+    int captured = capture_stack(raw_frames, kMaxFrames + kSkipFrames);
+    int first = first_caller_frame(raw_frames, captured, caller);
+
+    CallSite site;
+    strlcpy(site.context, current_context_name(), sizeof(site.context));
+    site.num_frames = std::min(kMaxFrames, captured - first);
+    memset(site.frames, 0, sizeof(site.frames));
+    memcpy(site.frames, raw_frames + first, site.num_frames * sizeof(void*));
+
+    call_site_profile[site].add(n);
+    context_profile[site.context].add(n);
+
+    profiler_busy = false;
+}
+
+static bool should_sample_alloc()
+{
+    if (alloc_sample_rate == 0 || profiler_busy) return false;
+    if (--alloc_sample_countdown > 0) return false;
+    alloc_sample_countdown = alloc_sample_rate;
+    return true;
+}
+
+void set_alloc_sample_rate(unsigned int every_n)
+{
+    alloc_sample_rate = every_n;
+    alloc_sample_countdown = every_n;
+}
+
+void reset_alloc_profile()
+{
+    profiler_busy = true;
+    call_site_profile.clear();
+    context_profile.clear();
+    profiler_busy = false;
+}
+
+static std::string describe_frame(void* frame)
+{
+    char fallback[32];
+    snprintf(fallback, sizeof(fallback), "%p", frame);
+#ifdef _WIN32
+    return fallback;
+#else
+    Dl_info info;
+    if (dladdr(frame, &info) == 0 || info.dli_sname == nullptr)
+    {
+        if (info.dli_fname != nullptr)
+        {
+            const char* module = strrchr(info.dli_fname, '/');
+            module = module ? module + 1 : info.dli_fname;
+            return std::string(module) + "+" + fallback;
+        }
+        return fallback;
+    }
+
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    std::string name = (status == 0 && demangled) ? demangled : info.dli_sname;
+    free(demangled);
+
+    // ';' separates frames in the collapsed format, so it can't
+    // appear inside one.
+    std::replace(name.begin(), name.end(), ';', ':');
+    return name;
+#endif
+}
+
+void write_alloc_profile(std::ostream& s, AllocProfileMetric metric)
+{
+    profiler_busy = true;
+    std::size_t scale = alloc_sample_rate == 0 ? 1 : alloc_sample_rate;
+    for (auto& entry : call_site_profile)
+    {
+        const CallSite& site = entry.first;
+        s << "[" << site.context << "]";
+        // Frames are captured leaf-first; collapsed stacks are root-first.
+        for (int i = site.num_frames - 1; i >= 0; i--)
+        {
+            s << ";" << describe_frame(site.frames[i]);
+        }
+        std::size_t weight = metric == AllocProfileMetric::COUNT ? entry.second.count : entry.second.bytes;
+        s << " " << weight * scale << "\n";
+    }
+    profiler_busy = false;
+}
+
+void write_alloc_histograms(std::ostream& s)
+{
+    profiler_busy = true;
+    s << "==== Allocation Profile (1 in " << alloc_sample_rate << " sampled) ====\n";
+    for (auto& entry : context_profile)
+    {
+        const SizeHistogram& h = entry.second;
+        s << entry.first << ": " << h.count << " samples, " << h.bytes << " bytes\n";
+        for (int i = 0; i < kSizeBuckets; i++)
+        {
+            if (h.buckets[i] == 0) continue;
+            s << "  <= " << ((std::size_t)1 << i) << " bytes: " << h.buckets[i] << "\n";
+        }
+    }
+    profiler_busy = false;
+}
+
+// ==== Allocation budgets ====
+
+AllocationBudgetExceeded::AllocationBudgetExceeded(const char* message)
+{
+    strlcpy(_message, message, sizeof(_message));
+}
+
+// Only the first overrun in a context prints its stack; code that
+// swallows the exception (iostreams do) may keep on allocating.
+PROFILER_NOINLINE static void report_budget_exceeded(AllocationContext* ctx, std::size_t n, void* caller)
+{
+    profiler_busy = true;
+
+    char message[160];
+    snprintf(message, sizeof(message),
+             "Allocation budget for '%s' exceeded: %zu byte allocation "
+             "(%u/%u allocations, %zu/%zu bytes so far)",
+             ctx->_name, n, ctx->_budget_allocs, ctx->_budget.max_allocations,
+             ctx->_budget_bytes, ctx->_budget.max_bytes);
+
+    if (!ctx->_budget_exceeded)
+    {
+        void* frames[kMaxFrames + kSkipFrames];
+        int num_frames = capture_stack(frames, kMaxFrames + kSkipFrames);
+        std::cerr << "!!!!! " << message << " !!!!!\n";
+        for (int i = first_caller_frame(frames, num_frames, caller); i < num_frames; i++)
+        {
+            std::cerr << "    at " << describe_frame(frames[i]) << "\n";
+        }
+    }
+    ctx->_budget_exceeded = true;
+
+    profiler_busy = false;
+
+#ifdef ALLOCATION_BUDGET_THROWS
+    throw AllocationBudgetExceeded(message);
+#else
+    abort();
+#endif
+}
+
+// Charges an allocation of n bytes to every budgeted context on the
+// stack, before any memory is actually handed out. Every budget is
+// checked before any is charged, so when one breaks (and throws) the
+// counts of the others aren't left including an allocation that
+// never happened.
+static void charge_alloc_budgets(std::size_t n, void* caller)
+{
+    if (profiler_busy) return;
+    for (AllocationContext* ctx = p_current_context; ctx != nullptr; ctx = ctx->_p_last_context)
+    {
+        if (!ctx->_has_budget) continue;
+        if (ctx->_budget_allocs + 1 > ctx->_budget.max_allocations
+            || ctx->_budget_bytes + n > ctx->_budget.max_bytes)
+        {
+            report_budget_exceeded(ctx, n, caller);
+        }
+    }
+    for (AllocationContext* ctx = p_current_context; ctx != nullptr; ctx = ctx->_p_last_context)
+    {
+        if (!ctx->_has_budget) continue;
+        ctx->_budget_allocs++;
+        ctx->_budget_bytes += n;
+    }
+}
+
+// ==== Global new/delete replacements ====
+
+static std::atomic<std::size_t> total_allocations{ 0 };
+static std::atomic<std::size_t> live_allocations{ 0 };
+static std::atomic<std::size_t> live_bytes{ 0 };
+static std::atomic<std::size_t> peak_live_bytes{ 0 };
+static std::atomic<std::size_t> live_bytes_by_class[kSizeBuckets];
+
+AllocationStats get_allocation_stats()
+{
+    AllocationStats stats;
+    stats.total_allocations = total_allocations.load(std::memory_order_relaxed);
+    stats.live_allocations = live_allocations.load(std::memory_order_relaxed);
+    stats.live_bytes = live_bytes.load(std::memory_order_relaxed);
+    stats.peak_live_bytes = peak_live_bytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+std::size_t get_live_bytes_in_size_class(int size_class)
+{
+    if (size_class < 0 || size_class >= kSizeBuckets) return 0;
+    return live_bytes_by_class[size_class].load(std::memory_order_relaxed);
+}
+
+static void* raw_alloc(std::size_t n, std::size_t align)
+{
+    if (align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+        return std::malloc(n == 0 ? 1 : n);
+#ifdef _WIN32
+    return _aligned_malloc(n == 0 ? 1 : n, align);
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, align, n == 0 ? 1 : n) != 0)
+        return nullptr;
+    return p;
+#endif
+}
+
+static void raw_free(void* p, std::size_t align)
+{
+#ifdef _WIN32
+    if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+    {
+        _aligned_free(p);
+        return;
+    }
+#else
+    (void)align;
+#endif
+    std::free(p);
+}
+
+// Every operator new overload ends up here. Kept out-of-line so its
+// return address marks where the profiler's frames end.
+PROFILER_NOINLINE static void* tracked_alloc(std::size_t n, std::size_t align, const char* kind)
+{
+  void* caller = PROFILER_RETURN_ADDRESS();
+  charge_alloc_budgets(n, caller);
+  void *p = raw_alloc(n, align);
   if (p == nullptr)
       throw std::bad_alloc();
   allocs[p] = n;
-  (*p_alloc_counter)++;
+
+  total_allocations.fetch_add(1, std::memory_order_relaxed);
+  live_allocations.fetch_add(1, std::memory_order_relaxed);
+  live_bytes_by_class[size_bucket(n)].fetch_add(n, std::memory_order_relaxed);
+  std::size_t now_live = live_bytes.fetch_add(n, std::memory_order_relaxed) + n;
+  std::size_t peak = peak_live_bytes.load(std::memory_order_relaxed);
+  while (now_live > peak
+         && !peak_live_bytes.compare_exchange_weak(peak, now_live, std::memory_order_relaxed))
+  {
+  }
+
+  if (!profiler_busy)
+      (*p_alloc_counter)++;
+  if (should_sample_alloc())
+      record_alloc_sample(n, caller);
   if (allocs_should_print)
   {
-      std::cout << "  Alloc: " << n << " bytes at " << std::hex << std::showbase << p << std::dec << '\n';
+      std::cout << "  " << kind << ": " << n << " bytes at " << std::hex << std::showbase << p << std::dec << '\n';
   }
   return p;
 }
-void operator delete(void * p) throw()
+
+static void tracked_free(void* p, std::size_t align, const char* kind)
 {
-  std::size_t n = allocs.at(p);
-  if (allocs_should_print)
+  if (p == nullptr) return;
+  auto it = allocs.find(p);
+  if (it != allocs.end())
   {
-      std::cout << "Dealloc: " << n << " bytes at " << std::hex << std::showbase << p << std::dec << '\n';
+      std::size_t n = it->second;
+      if (allocs_should_print)
+      {
+          std::cout << kind << ": " << n << " bytes at " << std::hex << std::showbase << p << std::dec << '\n';
+      }
+      live_allocations.fetch_sub(1, std::memory_order_relaxed);
+      live_bytes.fetch_sub(n, std::memory_order_relaxed);
+      live_bytes_by_class[size_bucket(n)].fetch_sub(n, std::memory_order_relaxed);
+      allocs.erase(it);
   }
-  std::free(p);
-  allocs.erase(p);
+  raw_free(p, align);
 }
 
+static void* tracked_alloc_nothrow(std::size_t n, std::size_t align, const char* kind) noexcept
+{
+  try
+  {
+      return tracked_alloc(n, align, kind);
+  }
+  catch (...)
+  {
+      return nullptr;
+  }
+}
+
+static const std::size_t kDefaultAlign = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+void * operator new(std::size_t n) { return tracked_alloc(n, kDefaultAlign, "Alloc"); }
+void * operator new[](std::size_t n) { return tracked_alloc(n, kDefaultAlign, "Alloc[]"); }
+void * operator new(std::size_t n, std::align_val_t a) { return tracked_alloc(n, (std::size_t)a, "Alloc"); }
+void * operator new[](std::size_t n, std::align_val_t a) { return tracked_alloc(n, (std::size_t)a, "Alloc[]"); }
+
+void * operator new(std::size_t n, const std::nothrow_t&) noexcept { return tracked_alloc_nothrow(n, kDefaultAlign, "Alloc"); }
+void * operator new[](std::size_t n, const std::nothrow_t&) noexcept { return tracked_alloc_nothrow(n, kDefaultAlign, "Alloc[]"); }
+void * operator new(std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return tracked_alloc_nothrow(n, (std::size_t)a, "Alloc"); }
+void * operator new[](std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return tracked_alloc_nothrow(n, (std::size_t)a, "Alloc[]"); }
+
+void operator delete(void * p) noexcept { tracked_free(p, kDefaultAlign, "Dealloc"); }
+void operator delete[](void * p) noexcept { tracked_free(p, kDefaultAlign, "Dealloc[]"); }
+void operator delete(void * p, std::size_t) noexcept { tracked_free(p, kDefaultAlign, "Dealloc"); }
+void operator delete[](void * p, std::size_t) noexcept { tracked_free(p, kDefaultAlign, "Dealloc[]"); }
+void operator delete(void * p, std::align_val_t a) noexcept { tracked_free(p, (std::size_t)a, "Dealloc"); }
+void operator delete[](void * p, std::align_val_t a) noexcept { tracked_free(p, (std::size_t)a, "Dealloc[]"); }
+void operator delete(void * p, std::size_t, std::align_val_t a) noexcept { tracked_free(p, (std::size_t)a, "Dealloc"); }
+void operator delete[](void * p, std::size_t, std::align_val_t a) noexcept { tracked_free(p, (std::size_t)a, "Dealloc[]"); }
+
+void operator delete(void * p, const std::nothrow_t&) noexcept { tracked_free(p, kDefaultAlign, "Dealloc"); }
+void operator delete[](void * p, const std::nothrow_t&) noexcept { tracked_free(p, kDefaultAlign, "Dealloc[]"); }
+void operator delete(void * p, std::align_val_t a, const std::nothrow_t&) noexcept { tracked_free(p, (std::size_t)a, "Dealloc"); }
+void operator delete[](void * p, std::align_val_t a, const std::nothrow_t&) noexcept { tracked_free(p, (std::size_t)a, "Dealloc[]"); }
+
 // Instance of a class that reports leaks when destroyed.
 // Statically constructed, so will be destroyed when
 // program exits (unless it crashes)
@@ -113,16 +537,40 @@ public:
 
 AllocationContext::AllocationContext(const char* name)
 {
+    _has_budget = false;
+    _budget = AllocationBudget{ 0, 0 };
+    _budget_allocs = 0;
+    _budget_bytes = 0;
+    _budget_exceeded = false;
     _alloc_counter = 0;
     _p_last_alloc_counter = p_alloc_counter;
     p_alloc_counter = &_alloc_counter;
-    strlcpy(_name, name, sizeof(_name));
+    _p_last_context = p_current_context;
+    p_current_context = this;
+    strlcpy(_name, name ? name : "(anonymous)", sizeof(_name));
     std::cout << "vvvvv Beginning Allocation Context '" << _name << "' vvvvv\n";
 }
 
+AllocationContext::AllocationContext(const char* name, AllocationBudget budget)
+{
+    _has_budget = true;
+    _budget = budget;
+    _budget_allocs = 0;
+    _budget_bytes = 0;
+    _budget_exceeded = false;
+    _alloc_counter = 0;
+    _p_last_alloc_counter = p_alloc_counter;
+    p_alloc_counter = &_alloc_counter;
+    _p_last_context = p_current_context;
+    p_current_context = this;
+    strlcpy(_name, name ? name : "(anonymous)", sizeof(_name));
+}
+
 AllocationContext::~AllocationContext()
 {
     p_alloc_counter = _p_last_alloc_counter;
+    p_current_context = _p_last_context;
     (*_p_last_alloc_counter) += _alloc_counter;
+    if (_has_budget) return;
     std::cout << "^^^^^ END '" << _name << "' (" << _alloc_counter << " allocations) ^^^^^\n";
 }
@@ -1,17 +1,116 @@
+#pragma once
+
 #include <string>
 #include <stdlib.h>
+#include <ostream>
+#include <new>
 
 size_t strlcpy(char* dst, const char* src, size_t siz);
 
 void set_allocs_should_print(bool should_print);
 
+// Allocation gauges
+// =================
+// Maintained by every replaced operator new/delete overload (scalar,
+// array, sized, aligned and nothrow). The gauges are atomics, cheap
+// to read at any time, from any thread. The tracker as a whole is
+// not thread-safe, though: the table of live allocations behind
+// them, the contexts and the profiler are unsynchronized, so only
+// one thread may allocate while it is linked in.
+struct AllocationStats
+{
+    size_t total_allocations;
+    size_t live_allocations;
+    size_t live_bytes;
+    size_t peak_live_bytes;
+};
+
+AllocationStats get_allocation_stats();
+
+// Size class i covers allocations of (2^(i-1), 2^i] bytes.
+size_t get_live_bytes_in_size_class(int size_class);
+
+// Allocation profiling
+// ====================
+// Captures the call stack of one in every `every_n` allocations
+// (0 turns sampling off, 1 samples everything). Samples are
+// aggregated per call site and per AllocationContext, along with a
+// power-of-two histogram of the requested sizes.
+//
+// On Linux, link with -rdynamic so the report can name functions
+// instead of printing raw addresses.
+void set_alloc_sample_rate(unsigned int every_n);
+void reset_alloc_profile();
+
+enum class AllocProfileMetric
+{
+    COUNT,
+    BYTES
+};
+
+// Writes one line per sampled call site in the "collapsed stack"
+// format understood by flamegraph.pl and speedscope:
+//     [Context];main;SendGameObject;operator new 12
+// Weights are scaled by the sample rate, so they estimate the real
+// totals.
+void write_alloc_profile(std::ostream& s, AllocProfileMetric metric = AllocProfileMetric::COUNT);
+
+// Human-readable summary: per-context totals and size histograms.
+void write_alloc_histograms(std::ostream& s);
+
+// Limits on how much a scope may allocate, including any contexts
+// nested inside it. Breaking a budget prints a report (with the
+// offending call stack) and aborts, or throws
+// AllocationBudgetExceeded when built with ALLOCATION_BUDGET_THROWS
+// (as test builds should be). Code that catches the exception and
+// carries on can hide the overrun, so check BudgetExceeded() too.
+struct AllocationBudget
+{
+    unsigned int max_allocations;
+    size_t max_bytes;
+};
+
+class AllocationBudgetExceeded : public std::bad_alloc
+{
+    public:
+    AllocationBudgetExceeded(const char* message);
+    const char* what() const noexcept override { return _message; }
+
+    char _message[160];
+};
+
 class AllocationContext
 {
     public:
     AllocationContext(const char* name=nullptr);
+    // Budgeted contexts are meant to wrap hot paths, so they don't
+    // print the begin/end banners unless the budget is broken.
+    AllocationContext(const char* name, AllocationBudget budget);
     ~AllocationContext();
 
+    // Whether an allocation in this scope broke its budget.
+    bool BudgetExceeded() const { return _budget_exceeded; }
+
     char _name[32];
     unsigned int _alloc_counter;
     unsigned int* _p_last_alloc_counter;
+    AllocationContext* _p_last_context;
+
+    bool _has_budget;
+    AllocationBudget _budget;
+    unsigned int _budget_allocs;
+    size_t _budget_bytes;
+    bool _budget_exceeded;
+};
+
+// Test/benchmark fixture for code that must never allocate, e.g.
+//
+//     {
+//         ZeroAllocationScope _("RecvFrom");
+//         sock.RecvFrom(buffer, sizeof(buffer), src);
+//     }
+class ZeroAllocationScope : public AllocationContext
+{
+    public:
+    ZeroAllocationScope(const char* name) : AllocationContext(name, AllocationBudget{ 0, 0 }) {}
 };
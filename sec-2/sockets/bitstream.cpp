@@ -0,0 +1,192 @@
+#include "bitstream.h"
+#include "wire_endian.h"
+#include <string.h>
+
+static uint64_t low_bits_mask(int bits)
+{
+  return bits >= 64 ? ~0ull : (1ull << bits) - 1;
+}
+
+static uint32_t range_of(int32_t min, int32_t max)
+{
+  return (uint32_t)((int64_t)max - (int64_t)min);
+}
+
+// ==== BitWriter ====
+
+BitWriter::BitWriter(char* buffer, size_t buffer_size):
+  _buffer(buffer),
+  _capacity_bits(buffer_size * 8),
+  _bits_written(0),
+  _byte_pos(0),
+  _scratch(0),
+  _scratch_bits(0),
+  _failed(false)
+{
+}
+
+bool BitWriter::Fail()
+{
+  _failed = true;
+  return false;
+}
+
+void BitWriter::FlushWord()
+{
+  store_le(_buffer + _byte_pos, (uint32_t)_scratch);
+  _byte_pos += 4;
+  _scratch >>= 32;
+  _scratch_bits -= 32;
+}
+
+void BitWriter::FlushWholeBytes()
+{
+  while (_scratch_bits >= 8)
+  {
+    _buffer[_byte_pos++] = (char)(_scratch & 0xff);
+    _scratch >>= 8;
+    _scratch_bits -= 8;
+  }
+}
+
+bool BitWriter::WriteBits(uint32_t value, int bits)
+{
+  if (_failed || bits < 1 || bits > 32 || _bits_written + bits > _capacity_bits) return Fail();
+
+  _scratch |= ((uint64_t)value & low_bits_mask(bits)) << _scratch_bits;
+  _scratch_bits += bits;
+  _bits_written += bits;
+  // Everything up to _bits_written is within capacity, so a whole
+  // word always fits here.
+  if (_scratch_bits >= 32) FlushWord();
+  return true;
+}
+
+bool BitWriter::WriteRanged(int32_t value, int32_t min, int32_t max)
+{
+  if (value < min || value > max) return Fail();
+  int bits = bits_required(range_of(min, max));
+  if (bits == 0) return ok();
+  return WriteBits((uint32_t)((int64_t)value - min), bits);
+}
+
+bool BitWriter::AlignToByte()
+{
+  int pad = (int)((8 - _bits_written % 8) % 8);
+  if (pad == 0) return ok();
+  return WriteBits(0, pad);
+}
+
+bool BitWriter::WriteBytes(const char* data, size_t len)
+{
+  if (!AlignToByte()) return false;
+  if (_bits_written + len * 8 > _capacity_bits) return Fail();
+
+  FlushWholeBytes();
+  if (len > 0) memcpy(_buffer + _byte_pos, data, len);
+  _byte_pos += len;
+  _bits_written += len * 8;
+  return true;
+}
+
+size_t BitWriter::Finish()
+{
+  if (_failed) return 0;
+  FlushWholeBytes();
+  // Leave the partial byte in the scratch register too, so writing
+  // can carry on after Finish().
+  if (_scratch_bits > 0) _buffer[_byte_pos] = (char)(_scratch & 0xff);
+  return BytesWritten();
+}
+
+// ==== BitReader ====
+
+BitReader::BitReader(const char* buffer, size_t buffer_size):
+  _buffer(buffer),
+  _buffer_size(buffer_size),
+  _capacity_bits(buffer_size * 8),
+  _bits_read(0),
+  _byte_pos(0),
+  _scratch(0),
+  _scratch_bits(0),
+  _failed(false)
+{
+}
+
+bool BitReader::Fail()
+{
+  _failed = true;
+  return false;
+}
+
+void BitReader::Refill()
+{
+  if (_scratch_bits <= 32 && _buffer_size - _byte_pos >= 4)
+  {
+    _scratch |= (uint64_t)load_le<uint32_t>(_buffer + _byte_pos) << _scratch_bits;
+    _scratch_bits += 32;
+    _byte_pos += 4;
+    return;
+  }
+  while (_scratch_bits <= 56 && _byte_pos < _buffer_size)
+  {
+    _scratch |= (uint64_t)(uint8_t)_buffer[_byte_pos++] << _scratch_bits;
+    _scratch_bits += 8;
+  }
+}
+
+uint32_t BitReader::ReadBits(int bits)
+{
+  if (_failed || bits < 1 || bits > 32 || _bits_read + bits > _capacity_bits)
+  {
+    Fail();
+    return 0;
+  }
+
+  if (_scratch_bits < bits) Refill();
+  uint32_t value = (uint32_t)(_scratch & low_bits_mask(bits));
+  _scratch >>= bits;
+  _scratch_bits -= bits;
+  _bits_read += bits;
+  return value;
+}
+
+int32_t BitReader::ReadRanged(int32_t min, int32_t max)
+{
+  uint32_t range = range_of(min, max);
+  int bits = bits_required(range);
+  if (bits == 0) return min;
+  uint32_t offset = ReadBits(bits);
+  if (offset > range)
+  {
+    Fail();
+    return min;
+  }
+  return (int32_t)((int64_t)min + offset);
+}
+
+bool BitReader::AlignToByte()
+{
+  int pad = (int)((8 - _bits_read % 8) % 8);
+  if (pad > 0) ReadBits(pad);
+  return ok();
+}
+
+bool BitReader::ReadBytes(char* out, size_t len)
+{
+  if (!AlignToByte()) return false;
+  if (_bits_read + len * 8 > _capacity_bits) return Fail();
+
+  // Bytes already pulled into the scratch register come first.
+  size_t i = 0;
+  while (i < len && _scratch_bits > 0)
+  {
+    out[i++] = (char)(_scratch & 0xff);
+    _scratch >>= 8;
+    _scratch_bits -= 8;
+  }
+  if (len > i) memcpy(out + i, _buffer + _byte_pos, len - i);
+  _byte_pos += len - i;
+  _bits_read += len * 8;
+  return true;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bytestring.h"
+
+// Bit-packed streams
+// ==================
+// For fields that don't need whole bytes: flags, booleans, enums and
+// integers with a known range. A set of 8 flags costs 8 bits, a bool
+// costs 1, and a value known to lie in [-1000, 1000] costs 11.
+//
+// Bits are collected in a 64-bit scratch register and written out a
+// 32-bit word at a time, so the per-field cost is a shift and an OR.
+// The byte stream is little-endian and bits are packed LSB-first, so
+// the same bytes decode identically on any host.
+//
+// AlignToByte() pads to the next byte boundary, after which
+// WriteBytes()/ReadBytes() can carry byte-aligned payloads (strings,
+// nested byte-stream messages) in the middle of a bit-packed section.
+//
+// Like the byte streams, errors are sticky: check ok() once at the end.
+
+// Bits needed to store any value in [0, range].
+constexpr int bits_required(uint32_t range)
+{
+  int bits = 0;
+  while (bits < 32 && (range >> bits) != 0) bits++;
+  return bits;
+}
+
+class BitWriter
+{
+ public:
+  BitWriter(char* buffer, size_t buffer_size);
+
+  // Writes the low `bits` bits of value (1 <= bits <= 32).
+  bool WriteBits(uint32_t value, int bits);
+
+  bool WriteBool(bool value) { return WriteBits(value ? 1 : 0, 1); }
+
+  // value must lie in [min, max]; costs bits_required(max - min) bits.
+  bool WriteRanged(int32_t value, int32_t min, int32_t max);
+
+  // The low num_flags bits of a bitflag set, e.g. a MOOD mask.
+  bool WriteFlags(uint32_t flags, int num_flags) { return WriteBits(flags, num_flags); }
+
+  bool AlignToByte();
+  // Aligns, then copies len bytes as-is.
+  bool WriteBytes(const char* data, size_t len);
+
+  // Writes out any partially-filled word. Returns the bytes used.
+  size_t Finish();
+
+  size_t BitsWritten() const { return _bits_written; }
+  size_t BytesWritten() const { return (_bits_written + 7) / 8; }
+  bool ok() const { return !_failed; }
+  ByteSpan span() const { return ByteSpan{ _buffer, BytesWritten() }; }
+
+ private:
+  void FlushWord();
+  void FlushWholeBytes();
+  bool Fail();
+
+  char* _buffer;
+  size_t _capacity_bits;
+  size_t _bits_written;
+  size_t _byte_pos;
+  uint64_t _scratch;
+  int _scratch_bits;
+  bool _failed;
+};
+
+class BitReader
+{
+ public:
+  BitReader(const char* buffer, size_t buffer_size);
+
+  // Reads `bits` bits (1 <= bits <= 32). Returns 0 past the end.
+  uint32_t ReadBits(int bits);
+
+  bool ReadBool() { return ReadBits(1) != 0; }
+
+  // Counterpart to WriteRanged(). Values outside [min, max] (which a
+  // well-formed writer never produces) fail the stream.
+  int32_t ReadRanged(int32_t min, int32_t max);
+
+  uint32_t ReadFlags(int num_flags) { return ReadBits(num_flags); }
+
+  bool AlignToByte();
+  bool ReadBytes(char* out, size_t len);
+
+  size_t BitsRead() const { return _bits_read; }
+  size_t BytesRead() const { return (_bits_read + 7) / 8; }
+  bool ok() const { return !_failed; }
+
+ private:
+  void Refill();
+  bool Fail();
+
+  const char* _buffer;
+  size_t _buffer_size;
+  size_t _capacity_bits;
+  size_t _bits_read;
+  size_t _byte_pos;
+  uint64_t _scratch;
+  int _scratch_bits;
+  bool _failed;
+};
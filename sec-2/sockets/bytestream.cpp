@@ -0,0 +1,95 @@
+#include "bytestream.h"
+
+OutByteStream::OutByteStream(char* buffer, size_t buffer_size):
+  OutByteStream(buffer, buffer_size, nullptr)
+{
+}
+
+OutByteStream::OutByteStream(char* buffer, size_t buffer_size, std::pmr::memory_resource* growth):
+  _buffer(buffer),
+  _buffer_size(buffer ? buffer_size : 0),
+  _limit(buffer ? buffer_size : 0),
+  _write_head(0),
+  _failed(false),
+  _growth(growth),
+  _owns_buffer(false)
+{
+}
+
+OutByteStream::OutByteStream(std::pmr::memory_resource* growth, size_t initial_size):
+  OutByteStream(nullptr, 0, growth)
+{
+  Grow(initial_size);
+}
+
+OutByteStream::~OutByteStream()
+{
+  if (_owns_buffer)
+  {
+    _growth->deallocate(_buffer, _buffer_size, alignof(max_align_t));
+  }
+}
+
+bool OutByteStream::Grow(size_t needed)
+{
+  if (_failed || _growth == nullptr)
+  {
+    _failed = true;
+    _limit = _write_head;
+    return false;
+  }
+
+  size_t new_size = _buffer_size * 2;
+  if (new_size < _write_head + needed) new_size = _write_head + needed;
+
+  char* grown;
+  try
+  {
+    grown = (char*)_growth->allocate(new_size, alignof(max_align_t));
+  }
+  catch (const std::bad_alloc&)
+  {
+    _failed = true;
+    _limit = _write_head;
+    return false;
+  }
+
+  if (_write_head > 0) memcpy(grown, _buffer, _write_head);
+  if (_owns_buffer)
+  {
+    _growth->deallocate(_buffer, _buffer_size, alignof(max_align_t));
+  }
+  _buffer = grown;
+  _buffer_size = new_size;
+  _limit = new_size;
+  _owns_buffer = true;
+  return true;
+}
+
+bool OutByteStream::InsertBytes(const char* data, size_t len)
+{
+  if (len > _limit - _write_head && !Grow(len)) return false;
+  if (len > 0) memcpy(_buffer + _write_head, data, len);
+  _write_head += len;
+  return true;
+}
+
+bool OutByteStream::InsertString(const char* str, size_t len)
+{
+  return Insert((uint32_t)len) && InsertBytes(str, len);
+}
+
+char* OutByteStream::Reserve(size_t len)
+{
+  if (len > _limit - _write_head && !Grow(len)) return nullptr;
+  char* reserved = _buffer + _write_head;
+  _write_head += len;
+  return reserved;
+}
+
+void OutByteStream::clear()
+{
+  _write_head = 0;
+  _failed = false;
+  _limit = _buffer_size;
+}
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <memory_resource>
+#include <type_traits>
+#include <string.h>
+#include <stdint.h>
+#include "bytestring.h"
+#include "wire_endian.h"
+#include "varint.h"
+#include <limits>
+
+// Serializes values into a byte buffer, little-endian (see
+// wire_endian.h). See InByteStream below for reading them back.
+//
+// The stream never owns the memory it starts with: it writes into
+// storage the caller provides (a stack array, a pool, an arena...).
+// If it was given a memory_resource to grow into, running out of room
+// moves the contents into a bigger block from that resource;
+// otherwise the write fails.
+//
+// Failures are sticky: once an Insert() fails, every later Insert()
+// fails too and ok() returns false, so a whole message can be written
+// and checked once at the end.
+class OutByteStream
+{
+ public:
+  // Writes into buffer and never grows.
+  OutByteStream(char* buffer, size_t buffer_size);
+  // Starts in buffer (which may be null), growing into `growth`.
+  OutByteStream(char* buffer, size_t buffer_size, std::pmr::memory_resource* growth);
+  explicit OutByteStream(std::pmr::memory_resource* growth, size_t initial_size = 256);
+  ~OutByteStream();
+
+  OutByteStream(const OutByteStream& other) = delete;
+  OutByteStream& operator=(const OutByteStream& other) = delete;
+
+  // Any fixed-width arithmetic or enum type.
+  template<typename T>
+  bool Insert(T value)
+  {
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                  "Insert() only takes fixed-width values; serialize other types field by field");
+    if (sizeof(T) > _limit - _write_head && !Grow(sizeof(T))) return false;
+    store_le(_buffer + _write_head, value);
+    _write_head += sizeof(T);
+    return true;
+  }
+
+  template<typename T>
+  bool InsertArray(const T* values, size_t count)
+  {
+    static_assert(std::is_arithmetic<T>::value, "InsertArray() only takes arithmetic types");
+    char* out = Reserve(count * sizeof(T));
+    if (out == nullptr) return false;
+    store_le_array(out, values, count);
+    return true;
+  }
+
+  // LEB128 varint (see varint.h): 1 byte for values under 128.
+  bool InsertVarint(uint64_t value)
+  {
+    if (kMaxVarintBytes > _limit - _write_head)
+    {
+      size_t size = varint_size(value);
+      if (size > _limit - _write_head && !Grow(size)) return false;
+    }
+    _write_head += varint_encode(value, _buffer + _write_head);
+    return true;
+  }
+
+  // Zigzag + varint, for signed values that are usually small.
+  bool InsertZigZag(int64_t value)
+  {
+    return InsertVarint(zigzag_encode(value));
+  }
+
+  bool InsertBytes(const char* data, size_t len);
+  // A uint32 length followed by the characters (no NUL).
+  bool InsertString(const char* str, size_t len);
+
+  // Hands out `len` bytes at the write head to be filled in later,
+  // e.g. a length prefix. Returns null on failure.
+  char* Reserve(size_t len);
+
+  char* data() { return _buffer; }
+  const char* data() const { return _buffer; }
+  size_t size() const { return _write_head; }
+  size_t bytes_remaining() const { return _limit - _write_head; }
+  bool ok() const { return !_failed; }
+  ByteSpan span() const { return ByteSpan{ _buffer, _write_head }; }
+
+  // Rewinds to empty (keeping any grown storage) and clears errors.
+  void clear();
+
+ private:
+  bool Grow(size_t needed);
+
+  char* _buffer;
+  size_t _buffer_size;
+  // Where writes have to stop. Equal to _buffer_size until a write
+  // fails, then pinned to _write_head so that every later write takes
+  // the (failing) Grow() path -- that keeps errors sticky without a
+  // second check in Insert().
+  size_t _limit;
+  size_t _write_head;
+  bool _failed;
+
+  std::pmr::memory_resource* _growth;
+  bool _owns_buffer;
+};
+
+// An OutByteStream with N bytes of storage inside the object, for
+// building messages on the stack.
+template<size_t N>
+class InlineOutByteStream : public OutByteStream
+{
+ public:
+  InlineOutByteStream(): OutByteStream(_storage, N) {}
+  explicit InlineOutByteStream(std::pmr::memory_resource* growth): OutByteStream(_storage, N, growth) {}
+
+ private:
+  char _storage[N];
+};
+
+// Reads values back out of a received buffer, without copying the
+// buffer itself.
+//
+// Reading past the end doesn't throw: it puts the stream into a
+// sticky failed state, and every later read fails too. Deserialize a
+// whole message, then check ok() once. A failed Read(), ReadVarint()
+// or ReadZigZag() zeroes its output; the array and span reads leave
+// theirs untouched, and so does anything built on them or on
+// Require(), like net_read() and operator>>.
+//
+// For hot paths, Require() does one bounds check for a whole
+// fixed-size message, after which ReadUnchecked() can pull the fields
+// out with no further checks.
+class InByteStream
+{
+ public:
+  InByteStream(): _buffer(nullptr), _size(0), _read_head(0), _failed(false) {}
+  InByteStream(const char* buffer, size_t size) { SetBuffer(buffer, size); }
+  explicit InByteStream(ByteSpan span) { SetBuffer(span.data, span.size); }
+
+  void SetBuffer(const char* buffer, size_t size)
+  {
+    _buffer = buffer;
+    _size = buffer ? size : 0;
+    _read_head = 0;
+    _failed = false;
+  }
+
+  bool Require(size_t len)
+  {
+    if (len <= _size - _read_head) return true;
+    Fail();
+    return false;
+  }
+
+  template<typename T>
+  void ReadUnchecked(T& out)
+  {
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                  "Read() only takes fixed-width values");
+    out = load_le<T>(_buffer + _read_head);
+    _read_head += sizeof(T);
+  }
+
+  template<typename T>
+  bool Read(T& out)
+  {
+    if (!Require(sizeof(T)))
+    {
+      out = T();
+      return false;
+    }
+    ReadUnchecked(out);
+    return true;
+  }
+
+  // Bulk copy of `count` values, e.g. an array of positions.
+  template<typename T>
+  bool ReadArray(T* out, size_t count)
+  {
+    static_assert(std::is_arithmetic<T>::value, "ReadArray() only takes arithmetic types");
+    if (count > (_size - _read_head) / sizeof(T))
+    {
+      Fail();
+      return false;
+    }
+    load_le_array(out, _buffer + _read_head, count);
+    _read_head += count * sizeof(T);
+    return true;
+  }
+
+  // Counterparts to InsertVarint()/InsertZigZag(). Values that don't
+  // fit in T are treated as malformed input.
+  template<typename T>
+  bool ReadVarint(T& out)
+  {
+    static_assert(std::is_unsigned<T>::value, "ReadVarint() reads unsigned values; use ReadZigZag() for signed ones");
+    uint64_t value;
+    size_t used = varint_decode(_buffer + _read_head, _size - _read_head, &value);
+    if (used == 0 || value > std::numeric_limits<T>::max())
+    {
+      Fail();
+      out = T();
+      return false;
+    }
+    _read_head += used;
+    out = (T)value;
+    return true;
+  }
+
+  template<typename T>
+  bool ReadZigZag(T& out)
+  {
+    static_assert(std::is_signed<T>::value && std::is_integral<T>::value, "ReadZigZag() reads signed integers");
+    uint64_t encoded;
+    if (!ReadVarint(encoded))
+    {
+      out = T();
+      return false;
+    }
+    int64_t value = zigzag_decode(encoded);
+    if (value < std::numeric_limits<T>::min() || value > std::numeric_limits<T>::max())
+    {
+      Fail();
+      out = T();
+      return false;
+    }
+    out = (T)value;
+    return true;
+  }
+
+  bool ReadVarintArray(uint32_t* out, size_t count)
+  {
+    size_t used = varint_decode_array(_buffer + _read_head, _size - _read_head, out, count);
+    if (used == 0 && count > 0)
+    {
+      Fail();
+      return false;
+    }
+    _read_head += used;
+    return true;
+  }
+
+  bool ReadBytes(char* out, size_t len)
+  {
+    return ReadArray(out, len);
+  }
+
+  // Zero-copy: returns a view of the next `len` bytes of the buffer.
+  ByteSpan ReadSpan(size_t len)
+  {
+    if (!Require(len)) return ByteSpan{ nullptr, 0 };
+    ByteSpan span{ _buffer + _read_head, len };
+    _read_head += len;
+    return span;
+  }
+
+  // Counterpart to OutByteStream::InsertString(). The span points into
+  // the stream's buffer.
+  ByteSpan ReadString()
+  {
+    uint32_t len = 0;
+    if (!Read(len)) return ByteSpan{ nullptr, 0 };
+    return ReadSpan(len);
+  }
+
+  bool Skip(size_t len)
+  {
+    if (!Require(len)) return false;
+    _read_head += len;
+    return true;
+  }
+
+  const char* data() const { return _buffer; }
+  size_t size() const { return _size; }
+  size_t position() const { return _read_head; }
+  size_t bytes_remaining() const { return _size - _read_head; }
+  bool ok() const { return !_failed; }
+
+ private:
+  void Fail()
+  {
+    _failed = true;
+    _read_head = _size;
+  }
+
+  const char* _buffer;
+  size_t _size;
+  size_t _read_head;
+  bool _failed;
+};
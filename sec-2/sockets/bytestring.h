@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include <utility>
+
+// A non-owning view of some bytes, e.g. the contents of an
+// OutByteStream on their way to Socket::SendAll().
+struct ByteSpan
+{
+  const char* data;
+  size_t size;
+};
+
+// A byte buffer that keeps up to InlineCapacity bytes inside the
+// object itself and only goes to the heap for larger contents. With
+// an inline capacity that covers typical packet sizes, building,
+// receiving and sending a message never allocates.
+//
+// The interface follows std::vector<char> closely enough to stand in
+// for it, plus a couple of extras for network code:
+//  - construction and append() from a pointer + length
+//  - resize_uninitialized(), for using the buffer as a recv() target
+//    without zeroing bytes that are about to be overwritten
+template<size_t InlineCapacity>
+class SmallByteString
+{
+ public:
+  typedef char value_type;
+  typedef char* iterator;
+  typedef const char* const_iterator;
+
+  SmallByteString(): _data(_inline), _size(0), _capacity(InlineCapacity) {}
+
+  SmallByteString(const char* data, size_t len): SmallByteString()
+  {
+    assign(data, len);
+  }
+
+  SmallByteString(const SmallByteString& other): SmallByteString()
+  {
+    assign(other.data(), other.size());
+  }
+
+  SmallByteString(SmallByteString&& other) noexcept: SmallByteString()
+  {
+    steal(other);
+  }
+
+  ~SmallByteString()
+  {
+    if (!is_inline()) delete[] _data;
+  }
+
+  SmallByteString& operator=(const SmallByteString& other)
+  {
+    if (this != &other) assign(other.data(), other.size());
+    return *this;
+  }
+
+  SmallByteString& operator=(SmallByteString&& other) noexcept
+  {
+    if (this != &other)
+    {
+      if (!is_inline()) delete[] _data;
+      _data = _inline;
+      _size = 0;
+      _capacity = InlineCapacity;
+      steal(other);
+    }
+    return *this;
+  }
+
+  char* data() { return _data; }
+  const char* data() const { return _data; }
+  size_t size() const { return _size; }
+  size_t capacity() const { return _capacity; }
+  bool empty() const { return _size == 0; }
+  bool is_inline() const { return _data == _inline; }
+
+  char* begin() { return _data; }
+  char* end() { return _data + _size; }
+  const char* begin() const { return _data; }
+  const char* end() const { return _data + _size; }
+
+  char& operator[](size_t i) { return _data[i]; }
+  const char& operator[](size_t i) const { return _data[i]; }
+
+  void clear() { _size = 0; }
+
+  void reserve(size_t new_capacity)
+  {
+    if (new_capacity <= _capacity) return;
+    char* grown = new char[new_capacity];
+    memcpy(grown, _data, _size);
+    if (!is_inline()) delete[] _data;
+    _data = grown;
+    _capacity = new_capacity;
+  }
+
+  // Changes the size without initializing any new bytes.
+  void resize_uninitialized(size_t new_size)
+  {
+    if (new_size > _capacity) reserve(grow_to(new_size));
+    _size = new_size;
+  }
+
+  void resize(size_t new_size, char fill = 0)
+  {
+    size_t old_size = _size;
+    resize_uninitialized(new_size);
+    if (new_size > old_size) memset(_data + old_size, fill, new_size - old_size);
+  }
+
+  void assign(const char* data, size_t len)
+  {
+    _size = 0;
+    append(data, len);
+  }
+
+  // data may point into this string's own bytes.
+  void append(const char* data, size_t len)
+  {
+    if (len == 0) return;
+    size_t new_size = _size + len;
+    if (new_size > _capacity)
+    {
+      // Copy data across before the buffer it may be in is freed.
+      size_t new_capacity = grow_to(new_size);
+      char* grown = new char[new_capacity];
+      memcpy(grown, _data, _size);
+      memcpy(grown + _size, data, len);
+      if (!is_inline()) delete[] _data;
+      _data = grown;
+      _capacity = new_capacity;
+    }
+    else
+    {
+      memmove(_data + _size, data, len);
+    }
+    _size = new_size;
+  }
+
+  void push_back(char c)
+  {
+    if (_size == _capacity) reserve(grow_to(_size + 1));
+    _data[_size++] = c;
+  }
+
+ private:
+  size_t grow_to(size_t min_capacity) const
+  {
+    size_t doubled = _capacity * 2;
+    return doubled > min_capacity ? doubled : min_capacity;
+  }
+
+  void steal(SmallByteString& other)
+  {
+    if (other.is_inline())
+    {
+      memcpy(_inline, other._inline, other._size);
+      _size = other._size;
+    }
+    else
+    {
+      _data = other._data;
+      _size = other._size;
+      _capacity = other._capacity;
+      other._data = other._inline;
+      other._capacity = InlineCapacity;
+    }
+    other._size = 0;
+  }
+
+  char* _data;
+  size_t _size;
+  size_t _capacity;
+  char _inline[InlineCapacity];
+};
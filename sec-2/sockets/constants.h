@@ -0,0 +1,17 @@
+#pragma once
+
+// Tuning for UDPClient (udp_client.h).
+
+// How long to wait for replies before resending the ones still
+// missing.
+const float kUdpClientTimeoutSeconds = 0.25f;
+
+// Sends of any one character before giving up on a message.
+const int kUdpClientMaxAttempts = 8;
+
+// Most characters in flight at once. A burst much bigger than the
+// socket's receive buffer (on either end) just gets dropped.
+const int kUdpClientWindow = 256;
+
+// Largest reply datagram accepted.
+const int kUdpClientMaxReply = 512;
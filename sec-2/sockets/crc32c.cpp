@@ -0,0 +1,206 @@
+#include "crc32c.h"
+#include "wire_endian.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CRC32C_HAVE_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <nmmintrin.h>
+#define CRC32C_TARGET
+#else
+#include <nmmintrin.h>
+// Compiled for SSE4.2 whatever the build flags, and only called once
+// the CPU says it has it.
+#define CRC32C_TARGET __attribute__((target("sse4.2")))
+#endif
+#define CRC32C_U8(crc, byte) _mm_crc32_u8((uint32_t)(crc), (uint8_t)(byte))
+#define CRC32C_U64(crc, word) _mm_crc32_u64((crc), (word))
+#elif defined(__ARM_FEATURE_CRC32)
+#define CRC32C_HAVE_ARM 1
+#include <arm_acle.h>
+#define CRC32C_TARGET
+#define CRC32C_U8(crc, byte) __crc32cb((uint32_t)(crc), (uint8_t)(byte))
+#define CRC32C_U64(crc, word) __crc32cd((uint32_t)(crc), (word))
+#endif
+
+// Reflected Castagnoli polynomial.
+static const uint32_t kPolynomial = 0x82f63b78;
+
+// Bytes per stream per round of the three-stream loops: long blocks
+// for bulk data, then short ones so packet-sized data runs three wide
+// too.
+static const size_t kLongBlock = 256;
+static const size_t kShortBlock = 64;
+
+struct Crc32cTables
+{
+  // slice[k][b]: byte b followed by k zero bytes.
+  uint32_t slice[8][256];
+  // shift_long[k][b]: the CRC state (b << 8k) advanced over kLongBlock
+  // zero bytes. The advance is linear, so any state is the XOR of its
+  // four bytes' entries. shift_short likewise for kShortBlock.
+  uint32_t shift_long[4][256];
+  uint32_t shift_short[4][256];
+};
+
+static uint32_t advance_zero_bytes(const Crc32cTables& t, uint32_t crc, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+    crc = t.slice[0][crc & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+static const Crc32cTables& tables()
+{
+  static const Crc32cTables* t = [] {
+    static Crc32cTables tables;
+    for (uint32_t b = 0; b < 256; b++)
+    {
+      uint32_t crc = b;
+      for (int bit = 0; bit < 8; bit++)
+        crc = (crc & 1) ? (crc >> 1) ^ kPolynomial : crc >> 1;
+      tables.slice[0][b] = crc;
+    }
+    for (int k = 1; k < 8; k++)
+      for (int b = 0; b < 256; b++)
+        tables.slice[k][b] = (tables.slice[k - 1][b] >> 8) ^ tables.slice[0][tables.slice[k - 1][b] & 0xff];
+    for (int k = 0; k < 4; k++)
+    {
+      for (uint32_t b = 0; b < 256; b++)
+      {
+        tables.shift_long[k][b] = advance_zero_bytes(tables, b << (8 * k), kLongBlock);
+        tables.shift_short[k][b] = advance_zero_bytes(tables, b << (8 * k), kShortBlock);
+      }
+    }
+    return &tables;
+  }();
+  return *t;
+}
+
+static uint32_t crc32c_software(const Crc32cTables& t, uint32_t crc, const char* data, size_t len)
+{
+  const uint8_t* p = (const uint8_t*)data;
+  for (; len >= 8; p += 8, len -= 8)
+  {
+    uint32_t low = load_le<uint32_t>((const char*)p) ^ crc;
+    uint32_t high = load_le<uint32_t>((const char*)p + 4);
+    crc = t.slice[7][low & 0xff] ^ t.slice[6][(low >> 8) & 0xff] ^
+          t.slice[5][(low >> 16) & 0xff] ^ t.slice[4][low >> 24] ^
+          t.slice[3][high & 0xff] ^ t.slice[2][(high >> 8) & 0xff] ^
+          t.slice[1][(high >> 16) & 0xff] ^ t.slice[0][high >> 24];
+  }
+  for (; len > 0; p++, len--)
+    crc = t.slice[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(CRC32C_HAVE_X86) || defined(CRC32C_HAVE_ARM)
+static inline uint32_t shift_block(const uint32_t (&shift)[4][256], uint32_t crc)
+{
+  return shift[0][crc & 0xff] ^ shift[1][(crc >> 8) & 0xff] ^
+         shift[2][(crc >> 16) & 0xff] ^ shift[3][crc >> 24];
+}
+
+// The instruction takes 3 cycles but can start one every cycle, so
+// one stream of data runs at a third of its speed. Three consecutive
+// blocks are checksummed independently and then joined: the CRC of
+// A then B is the CRC of A advanced over len(B) zero bytes, XOR the
+// CRC of B alone.
+template<size_t kBlock>
+CRC32C_TARGET static inline uint64_t crc32c_three_streams(const uint32_t (&shift)[4][256], uint64_t crc0,
+                                                          const char*& p, size_t& len)
+{
+  for (; len >= 3 * kBlock; len -= 3 * kBlock)
+  {
+    uint64_t crc1 = 0;
+    uint64_t crc2 = 0;
+    const char* end = p + kBlock;
+    for (; p < end; p += 8)
+    {
+      crc0 = CRC32C_U64(crc0, load_le<uint64_t>(p));
+      crc1 = CRC32C_U64(crc1, load_le<uint64_t>(p + kBlock));
+      crc2 = CRC32C_U64(crc2, load_le<uint64_t>(p + 2 * kBlock));
+    }
+    crc0 = shift_block(shift, (uint32_t)crc0) ^ (uint32_t)crc1;
+    crc0 = shift_block(shift, (uint32_t)crc0) ^ (uint32_t)crc2;
+    p += 2 * kBlock;
+  }
+  return crc0;
+}
+
+CRC32C_TARGET static uint32_t crc32c_hardware(const Crc32cTables& t, uint32_t crc, const char* data, size_t len)
+{
+  const char* p = data;
+  uint64_t crc0 = crc;
+  for (; len > 0 && ((uintptr_t)p & 7) != 0; p++, len--)
+    crc0 = CRC32C_U8(crc0, *p);
+
+  crc0 = crc32c_three_streams<kLongBlock>(t.shift_long, crc0, p, len);
+  crc0 = crc32c_three_streams<kShortBlock>(t.shift_short, crc0, p, len);
+  for (; len >= 8; p += 8, len -= 8)
+    crc0 = CRC32C_U64(crc0, load_le<uint64_t>(p));
+  for (; len > 0; p++, len--)
+    crc0 = CRC32C_U8(crc0, *p);
+  return (uint32_t)crc0;
+}
+#endif
+
+static bool cpu_has_crc32()
+{
+#if defined(CRC32C_HAVE_X86) && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 20)) != 0;
+#elif defined(CRC32C_HAVE_X86)
+  return __builtin_cpu_supports("sse4.2");
+#elif defined(CRC32C_HAVE_ARM)
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool crc32c_hardware_accelerated()
+{
+  static const bool accelerated = cpu_has_crc32();
+  return accelerated;
+}
+
+uint32_t crc32c(const char* data, size_t len, uint32_t crc)
+{
+  const Crc32cTables& t = tables();
+  crc = ~crc;
+#if defined(CRC32C_HAVE_X86) || defined(CRC32C_HAVE_ARM)
+  if (crc32c_hardware_accelerated()) return ~crc32c_hardware(t, crc, data, len);
+#endif
+  return ~crc32c_software(t, crc, data, len);
+}
+
+bool append_crc_trailer(OutByteStream& stream)
+{
+  uint32_t crc = crc32c(stream.data(), stream.size());
+  return stream.Insert(crc);
+}
+
+bool check_crc_trailer(const char* packet, size_t len, ByteSpan& payload)
+{
+  if (len < kCrcTrailerSize) return false;
+  size_t payload_size = len - kCrcTrailerSize;
+  if (crc32c(packet, payload_size) != load_le<uint32_t>(packet + payload_size)) return false;
+  payload = ByteSpan{ packet, payload_size };
+  return true;
+}
+
+size_t send_checked_datagram(Socket& socket, OutByteStream& packet, const Address& dest)
+{
+  if (!append_crc_trailer(packet)) return 0;
+  return socket.SendTo(packet.data(), packet.size(), dest);
+}
+
+CheckedRecvStatus recv_checked_datagram(Socket& socket, char* buffer, int size, Address& src, ByteSpan& payload)
+{
+  int count = socket.RecvFrom(buffer, size, src);
+  if (count < 0) return DATAGRAM_WOULD_BLOCK;
+  if (count >= size) return DATAGRAM_CORRUPT;
+  return check_crc_trailer(buffer, (size_t)count, payload) ? DATAGRAM_OK : DATAGRAM_CORRUPT;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bytestream.h"
+#include "bytestring.h"
+#include "socklib.h"
+
+// CRC32C packet trailers
+// ======================
+// UDP only carries a 16-bit checksum (optional over IPv4), which
+// misses plenty of real corruption, and the deserializers trust
+// whatever bytes arrive. An optional trailer guards a datagram end to
+// end:
+//
+//     ...     payload
+//     uint32  CRC32C of the payload, little-endian
+//
+// CRC32C (the Castagnoli polynomial, as in iSCSI and ext4) has a
+// crc32 instruction on x86 since SSE4.2 and on ARMv8. crc32c() uses
+// it when the CPU has it, running three independent streams at once
+// to hide the instruction's latency, and falls back to a
+// slicing-by-8 table otherwise. Either way the result is the same.
+//
+// Both ends have to agree to use trailers; there is no flag on the
+// wire.
+
+// CRC32C of len bytes. To checksum data in pieces, pass the previous
+// result as crc.
+uint32_t crc32c(const char* data, size_t len, uint32_t crc = 0);
+inline uint32_t crc32c(ByteSpan data, uint32_t crc = 0) { return crc32c(data.data, data.size, crc); }
+
+// Whether crc32c() is using the CPU's crc32 instruction.
+bool crc32c_hardware_accelerated();
+
+const size_t kCrcTrailerSize = 4;
+
+// Appends the CRC32C of everything in stream so far.
+bool append_crc_trailer(OutByteStream& stream);
+
+// Checks the trailer of a received packet. On success, points payload
+// at the packet minus its trailer. Fails for packets too short to
+// have one.
+bool check_crc_trailer(const char* packet, size_t len, ByteSpan& payload);
+inline bool check_crc_trailer(ByteSpan packet, ByteSpan& payload) { return check_crc_trailer(packet.data, packet.size, payload); }
+
+enum CheckedRecvStatus
+{
+  DATAGRAM_OK,
+  // Nothing to receive (non-blocking socket, or timeout).
+  DATAGRAM_WOULD_BLOCK,
+  // Bad or missing trailer, or too big for the buffer (the OS
+  // silently cuts those short). Drop it.
+  DATAGRAM_CORRUPT
+};
+
+// Appends a trailer to packet and sends it as one datagram. Returns
+// the bytes sent, or 0 if the trailer didn't fit in the stream.
+size_t send_checked_datagram(Socket& socket, OutByteStream& packet, const Address& dest);
+
+// Receives one datagram into buffer and checks its trailer. payload
+// points into buffer. A datagram that fills the whole buffer counts
+// as truncated, so make the buffer at least a byte bigger than the
+// largest datagram expected.
+CheckedRecvStatus recv_checked_datagram(Socket& socket, char* buffer, int size, Address& src, ByteSpan& payload);
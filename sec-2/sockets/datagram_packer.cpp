@@ -0,0 +1,119 @@
+#include "datagram_packer.h"
+#include <string.h>
+#include <algorithm>
+#include "varint.h"
+
+DatagramPacker::DatagramPacker(Socket& socket, size_t mtu):
+  _socket(socket),
+  _mtu(mtu),
+  _budget(0),
+  _last_found(0)
+{
+}
+
+size_t DatagramPacker::MaxMessageSize() const
+{
+  // A length prefix never needs more bytes than the MTU's own would.
+  size_t prefix = varint_size(_mtu);
+  return _mtu > prefix ? _mtu - prefix : 0;
+}
+
+// Destinations are kept once seen, so their buffers get reused from
+// tick to tick.
+DatagramPacker::Destination& DatagramPacker::Find(const Address& dest)
+{
+  if (_last_found < _destinations.size() && _destinations[_last_found].address == dest)
+    return _destinations[_last_found];
+  for (size_t i = 0; i < _destinations.size(); i++)
+  {
+    if (_destinations[i].address == dest)
+    {
+      _last_found = i;
+      return _destinations[i];
+    }
+  }
+  _destinations.emplace_back();
+  _destinations.back().address = dest;
+  _last_found = _destinations.size() - 1;
+  return _destinations.back();
+}
+
+bool DatagramPacker::Queue(const Address& dest, const char* data, size_t len, int priority)
+{
+  if (len > MaxMessageSize()) return false;
+  Destination& destination = Find(dest);
+  destination.pending.push_back(Pending{ priority, destination.bytes.size(), len });
+  destination.bytes.insert(destination.bytes.end(), data, data + len);
+  return true;
+}
+
+size_t DatagramPacker::MessagesQueued() const
+{
+  size_t count = 0;
+  for (const Destination& destination : _destinations) count += destination.pending.size();
+  return count;
+}
+
+size_t DatagramPacker::FlushDestination(Destination& destination)
+{
+  _order = destination.pending;
+  std::stable_sort(_order.begin(), _order.end(),
+                   [](const Pending& a, const Pending& b) { return a.priority > b.priority; });
+
+  size_t framed_total = 0;
+  for (const Pending& message : _order) framed_total += varint_size(message.size) + message.size;
+  if (_datagrams.size() < framed_total) _datagrams.resize(framed_total);
+
+  _spans.clear();
+  char* out = _datagrams.data();
+  size_t datagram_start = 0;
+  size_t pos = 0;
+  size_t sent = 0;
+  for (; sent < _order.size(); sent++)
+  {
+    const Pending& message = _order[sent];
+    size_t framed = varint_size(message.size) + message.size;
+    if (_budget != 0 && pos + framed > _budget) break;
+    if (pos - datagram_start + framed > _mtu)
+    {
+      _spans.push_back(ByteSpan{ out + datagram_start, pos - datagram_start });
+      datagram_start = pos;
+    }
+    pos += varint_encode(message.size, out + pos);
+    memcpy(out + pos, destination.bytes.data() + message.offset, message.size);
+    pos += message.size;
+  }
+  if (pos > datagram_start) _spans.push_back(ByteSpan{ out + datagram_start, pos - datagram_start });
+
+  if (!_spans.empty())
+  {
+    _socket.SendToBatch(_spans.data(), (int)_spans.size(), destination.address);
+    _stats.batches++;
+    _stats.datagrams += _spans.size();
+    _stats.messages += sent;
+    _stats.bytes += pos;
+  }
+
+  // Whatever the budget held back goes first next time, in the order
+  // it would have gone now.
+  _carried.clear();
+  _carried_bytes.clear();
+  for (size_t i = sent; i < _order.size(); i++)
+  {
+    const Pending& message = _order[i];
+    _carried.push_back(Pending{ message.priority, _carried_bytes.size(), message.size });
+    const char* data = destination.bytes.data() + message.offset;
+    _carried_bytes.insert(_carried_bytes.end(), data, data + message.size);
+  }
+  destination.pending.swap(_carried);
+  destination.bytes.swap(_carried_bytes);
+  return _spans.size();
+}
+
+size_t DatagramPacker::Flush()
+{
+  size_t datagrams = 0;
+  for (Destination& destination : _destinations)
+    if (!destination.pending.empty()) datagrams += FlushDestination(destination);
+  return datagrams;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "bytestream.h"
+#include "bytestring.h"
+#include "socklib.h"
+
+// Datagram packing
+// ================
+// One SendTo() per message means one datagram per message: 28 bytes
+// of IP and UDP header and a system call for what is often a
+// 10-byte update. DatagramPacker instead collects a tick's messages
+// per destination and, at the end of the tick, packs them into as
+// few datagrams of up to mtu bytes as they fit, each message framed
+// as
+//
+//     varint  length
+//     ...     message
+//
+// then hands each destination's datagrams to the socket in one
+// SendToBatch() (one sendmmsg() on Linux). Read them back with
+// next_packed_message().
+//
+// Messages go out highest priority first, and in queue order within
+// a priority. With a byte budget set, each destination gets at most
+// that much per Flush(); whatever doesn't fit waits for the next
+// one, still ahead of anything queued later at the same priority.
+// Messages are never split across datagrams.
+
+const size_t kDefaultPackerMtu = 1200;
+
+// Pops the next message from a packed datagram. False at the end, or
+// (with in.ok() false) on a malformed one.
+inline bool next_packed_message(InByteStream& in, ByteSpan& message)
+{
+  if (in.bytes_remaining() == 0) return false;
+  uint32_t len = 0;
+  if (!in.ReadVarint(len)) return false;
+  message = in.ReadSpan(len);
+  return in.ok();
+}
+
+class DatagramPacker
+{
+ public:
+  struct Stats
+  {
+    size_t messages = 0;
+    size_t datagrams = 0;
+    // SendToBatch() calls.
+    size_t batches = 0;
+    size_t bytes = 0;
+  };
+
+  explicit DatagramPacker(Socket& socket, size_t mtu = kDefaultPackerMtu);
+
+  DatagramPacker(const DatagramPacker& other) = delete;
+  DatagramPacker& operator=(const DatagramPacker& other) = delete;
+
+  // Queues a message for dest. Higher priorities go first. Returns
+  // false (and queues nothing) if it can't fit in one datagram.
+  bool Queue(const Address& dest, const char* data, size_t len, int priority = 0);
+  bool Queue(const Address& dest, ByteSpan message, int priority = 0) { return Queue(dest, message.data, message.size, priority); }
+
+  // Bytes of datagram per destination per Flush(); 0 for no limit.
+  // Never less than one MTU, so every message can eventually go.
+  void SetBudget(size_t bytes_per_flush)
+  {
+    _budget = bytes_per_flush != 0 && bytes_per_flush < _mtu ? _mtu : bytes_per_flush;
+  }
+
+  // Packs and sends what's queued, within the budget. Call at the end
+  // of every tick. Returns the datagrams sent.
+  size_t Flush();
+
+  size_t MessagesQueued() const;
+  size_t Mtu() const { return _mtu; }
+  const Stats& GetStats() const { return _stats; }
+
+  // The largest message that fits in one datagram.
+  size_t MaxMessageSize() const;
+
+ private:
+  struct Pending
+  {
+    int priority;
+    size_t offset;
+    size_t size;
+  };
+
+  struct Destination
+  {
+    Address address;
+    std::vector<Pending> pending;
+    // The queued messages, back to back.
+    std::vector<char> bytes;
+  };
+
+  Destination& Find(const Address& dest);
+  size_t FlushDestination(Destination& destination);
+
+  Socket& _socket;
+  size_t _mtu;
+  size_t _budget;
+  // A linear search: a game server has a handful of clients, and the
+  // last one found is checked first.
+  std::vector<Destination> _destinations;
+  size_t _last_found;
+
+  // Reused by every Flush().
+  std::vector<Pending> _order;
+  std::vector<Pending> _carried;
+  std::vector<char> _carried_bytes;
+  std::vector<char> _datagrams;
+  std::vector<ByteSpan> _spans;
+
+  Stats _stats;
+};
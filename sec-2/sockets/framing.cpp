@@ -0,0 +1,156 @@
+#include "framing.h"
+#include <limits.h>
+#include <string.h>
+#include <stdexcept>
+#include <string>
+#include "varint.h"
+
+bool write_frame(OutByteStream& stream, const char* data, size_t len)
+{
+  stream.InsertVarint(len);
+  return stream.InsertBytes(data, len);
+}
+
+// ==== FrameReader ====
+
+FrameReader::FrameReader(size_t max_frame_size, std::pmr::memory_resource* resource):
+  _resource(resource),
+  _max_frame_size(max_frame_size),
+  _buffer(nullptr),
+  // Room for the largest frame and its prefix, so a partial frame
+  // always fits once compacted.
+  _capacity(max_frame_size + varint_size(max_frame_size)),
+  _read_pos(0),
+  _write_pos(0)
+{
+  _buffer = (char*)_resource->allocate(_capacity, 1);
+}
+
+FrameReader::~FrameReader()
+{
+  _resource->deallocate(_buffer, _capacity, 1);
+}
+
+size_t FrameReader::Append(const char* data, size_t len)
+{
+  if (len > WriteSpace()) Compact();
+  size_t count = len < WriteSpace() ? len : WriteSpace();
+  memcpy(WriteHead(), data, count);
+  Commit(count);
+  return count;
+}
+
+bool FrameReader::Next(ByteSpan& frame)
+{
+  size_t available = _write_pos - _read_pos;
+  if (available == 0) return false;
+
+  uint64_t len;
+  size_t prefix = varint_decode(_buffer + _read_pos, available, &len);
+  if (prefix == 0)
+  {
+    // Not enough bytes for the prefix yet -- unless there are already
+    // more than the longest valid prefix needs.
+    if (available < varint_size(_max_frame_size)) return false;
+    throw std::runtime_error("Malformed frame length prefix");
+  }
+  if (len > _max_frame_size)
+  {
+    throw std::runtime_error("Frame of " + std::to_string(len) + " bytes exceeds the maximum of "
+                             + std::to_string(_max_frame_size));
+  }
+  if (available - prefix < len) return false;
+
+  frame = ByteSpan{ _buffer + _read_pos + prefix, (size_t)len };
+  _read_pos += prefix + (size_t)len;
+  // Drained: start over at the front (the bytes themselves stay put).
+  if (_read_pos == _write_pos) _read_pos = _write_pos = 0;
+  return true;
+}
+
+void FrameReader::Compact()
+{
+  if (_read_pos == 0) return;
+  size_t available = _write_pos - _read_pos;
+  memmove(_buffer, _buffer + _read_pos, available);
+  _read_pos = 0;
+  _write_pos = available;
+}
+
+// ==== FramedSocket ====
+
+FramedSocket::FramedSocket(Socket& socket, size_t max_frame_size, std::pmr::memory_resource* resource):
+  _socket(socket),
+  _resource(resource),
+  _reader(max_frame_size, resource),
+  _send_stream(resource, 4096),
+  _pack_buffer(nullptr),
+  _unpack_buffer(nullptr),
+  _compression_threshold(0)
+{
+}
+
+FramedSocket::~FramedSocket()
+{
+  if (_pack_buffer == nullptr) return;
+  _resource->deallocate(_pack_buffer, packed_payload_bound(_reader.MaxFrameSize()), 1);
+  _resource->deallocate(_unpack_buffer, _reader.MaxFrameSize(), 1);
+}
+
+void FramedSocket::EnableCompression(size_t threshold)
+{
+  _compression_threshold = threshold;
+  if (_pack_buffer != nullptr) return;
+  _pack_buffer = (char*)_resource->allocate(packed_payload_bound(_reader.MaxFrameSize()), 1);
+  _unpack_buffer = (char*)_resource->allocate(_reader.MaxFrameSize(), 1);
+}
+
+bool FramedSocket::QueueFrame(const char* data, size_t len)
+{
+  size_t max_frame_size = _reader.MaxFrameSize();
+  if (len > max_frame_size) return false;
+  if (_pack_buffer == nullptr) return write_frame(_send_stream, data, len);
+
+  size_t packed = pack_payload(data, len, _pack_buffer, packed_payload_bound(max_frame_size), _compression_threshold);
+  if (packed > max_frame_size) return false;
+  return write_frame(_send_stream, _pack_buffer, packed);
+}
+
+size_t FramedSocket::Flush()
+{
+  if (_send_stream.size() == 0) return 0;
+  size_t sent = _socket.SendAll(_send_stream.data(), _send_stream.size());
+  _send_stream.clear();
+  return sent;
+}
+
+bool FramedSocket::SendFrame(const char* data, size_t len)
+{
+  if (!QueueFrame(data, len)) return false;
+  Flush();
+  return true;
+}
+
+FramedSocket::RecvStatus FramedSocket::Unpack(ByteSpan& frame)
+{
+  if (_pack_buffer == nullptr) return FRAME;
+  if (!unpack_payload(frame, _unpack_buffer, _reader.MaxFrameSize(), frame))
+    throw std::runtime_error("Malformed compressed frame");
+  return FRAME;
+}
+
+FramedSocket::RecvStatus FramedSocket::RecvFrame(ByteSpan& frame)
+{
+  if (_reader.Next(frame)) return Unpack(frame);
+
+  _reader.Compact();
+  while (true)
+  {
+    size_t space = _reader.WriteSpace();
+    int count = _socket.Recv(_reader.WriteHead(), space < INT_MAX ? (int)space : INT_MAX);
+    if (count == -1) return WOULD_BLOCK;
+    if (count == 0) return CLOSED;
+    _reader.Commit(count);
+    if (_reader.Next(frame)) return Unpack(frame);
+  }
+}
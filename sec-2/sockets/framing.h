@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory_resource>
+#include "bytestream.h"
+#include "bytestring.h"
+#include "lz_codec.h"
+#include "socklib.h"
+
+// Length-prefixed framing
+// =======================
+// TCP is a byte stream: one Send() can arrive as several Recv()s, and
+// several Send()s can arrive in one Recv(). To get whole messages back
+// out, every message (frame) goes on the wire as
+//
+//     varint  payload length (1 byte under 128, 2 under 16K)
+//     ...     payload
+//
+// FrameReader turns whatever Recv() delivered back into frames. Bytes
+// are received straight into its buffer and frames are handed out as
+// spans into it, so a frame that arrives in one piece is never
+// copied; only the unfinished tail of the buffer moves when it needs
+// room.
+//
+// A length above the reader's max_frame_size is treated as a protocol
+// error (a corrupt or hostile peer), not a reason to allocate.
+
+const size_t kDefaultMaxFrameSize = 64 * 1024;
+
+// Appends one frame to stream. Returns false if the stream failed.
+bool write_frame(OutByteStream& stream, const char* data, size_t len);
+
+class FrameReader
+{
+ public:
+  explicit FrameReader(size_t max_frame_size = kDefaultMaxFrameSize,
+                       std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+  ~FrameReader();
+
+  FrameReader(const FrameReader& other) = delete;
+  FrameReader& operator=(const FrameReader& other) = delete;
+
+  // Where to receive into, and how much room there is. Always room for
+  // at least one byte while a frame is incomplete.
+  char* WriteHead() { return _buffer + _write_pos; }
+  size_t WriteSpace() const { return _capacity - _write_pos; }
+  // Records that len bytes were written at WriteHead().
+  void Commit(size_t len) { _write_pos += len; }
+  // Copies data in (for bytes that arrived somewhere else).
+  size_t Append(const char* data, size_t len);
+
+  // Pops the next whole frame. The span points into the buffer and
+  // stays valid until more bytes are written in (Commit(), Append())
+  // or Compact(). Throws std::runtime_error on an oversized or
+  // malformed length.
+  bool Next(ByteSpan& frame);
+
+  // Moves a partial frame to the front of the buffer.
+  void Compact();
+
+  size_t BytesBuffered() const { return _write_pos - _read_pos; }
+  size_t MaxFrameSize() const { return _max_frame_size; }
+
+ private:
+  std::pmr::memory_resource* _resource;
+  size_t _max_frame_size;
+  char* _buffer;
+  size_t _capacity;
+  size_t _read_pos;
+  size_t _write_pos;
+};
+
+// Frames over a connected STREAM socket.
+//
+// Sends are batched: QueueFrame() only appends to a send buffer, and
+// Flush() hands everything queued to the socket in one SendAll(), so
+// a tick's worth of small messages costs one syscall instead of one
+// each.
+//
+// With EnableCompression() (on both ends), every frame gets a flag
+// byte and frames of threshold bytes or more are LZ-compressed (see
+// lz_codec.h). The compression buffers come from the socket's
+// memory_resource, like the frame buffers.
+class FramedSocket
+{
+ public:
+  enum RecvStatus
+  {
+    FRAME,
+    // No whole frame yet (non-blocking socket, or timeout).
+    WOULD_BLOCK,
+    CLOSED
+  };
+
+  explicit FramedSocket(Socket& socket, size_t max_frame_size = kDefaultMaxFrameSize,
+                        std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+  ~FramedSocket();
+
+  FramedSocket(const FramedSocket& other) = delete;
+  FramedSocket& operator=(const FramedSocket& other) = delete;
+
+  // Call before the first frame goes either way. The flag byte counts
+  // towards the maximum frame size, so with compression on an
+  // incompressible frame can be at most max_frame_size - 1 bytes.
+  void EnableCompression(size_t threshold = kDefaultCompressionThreshold);
+  bool CompressionEnabled() const { return _pack_buffer != nullptr; }
+
+  // Returns false (and queues nothing) if len is over the maximum
+  // frame size.
+  bool QueueFrame(const char* data, size_t len);
+  bool QueueFrame(ByteSpan frame) { return QueueFrame(frame.data, frame.size); }
+  // Sends everything queued. Returns the bytes sent.
+  size_t Flush();
+  size_t BytesQueued() const { return _send_stream.size(); }
+
+  // QueueFrame() + Flush().
+  bool SendFrame(const char* data, size_t len);
+
+  // Receives until a whole frame is available (or the socket would
+  // block), and points frame at it, decompressed. The span stays valid
+  // until the next RecvFrame(). Throws std::runtime_error on a
+  // malformed frame.
+  RecvStatus RecvFrame(ByteSpan& frame);
+
+  Socket& socket() { return _socket; }
+
+ private:
+  RecvStatus Unpack(ByteSpan& frame);
+
+  Socket& _socket;
+  std::pmr::memory_resource* _resource;
+  FrameReader _reader;
+  OutByteStream _send_stream;
+
+  // Null until EnableCompression().
+  char* _pack_buffer;
+  char* _unpack_buffer;
+  size_t _compression_threshold;
+};
@@ -0,0 +1,99 @@
+#include <sstream>
+#include <string>
+
+#include "game_object.h"
+#include "bytestream.h"
+#include "bitstream.h"
+#include "net_text.h"
+
+// One option -- serialize to a string.
+size_t SerializeGameObjectAsString(const GameObject* go, char* buffer, size_t buffer_size)
+{
+	std::stringstream go_ss;
+
+	// Need spaces (or other delimiters) between each value
+	// Because otherwise "100" could mean either 100 or 1, 0, 0.
+	// So spaces tell us when one number has ended.
+	go_ss << go->x << " "
+		<< go->y << " "
+		<< go->z << " "
+		<< go->xVel << " "
+		<< go->yVel << " "
+		<< go->zVel;
+	std::string go_str = go_ss.str();
+
+	size_t bytes_copied = 0;
+	// Could replace the for loop below with strncpy(buffer, go_str.c_str(), buffer_size);
+	for (int i = 0; i < go_str.size() && i < buffer_size; i++) {
+		buffer[i] = go_str[i];
+		bytes_copied++;
+	}
+
+	return bytes_copied;
+}
+
+size_t DeserializeGameObjectAsString(GameObject* go, const char* buffer, size_t buffer_size)
+{
+	std::istringstream go_ss(std::string(buffer, buffer_size));
+	go_ss >> go->x >> go->y >> go->z >> go->xVel >> go->yVel >> go->zVel;
+	if (go_ss.fail()) return 0;
+	return buffer_size;
+}
+
+// The same text, formatted in place with to_chars (see net_text.h):
+// no stream, no temporary string, no allocation. Returns 0 if it
+// didn't fit, rather than cutting the text short.
+size_t SerializeGameObjectAsText(const GameObject* go, char* buffer, size_t buffer_size)
+{
+	char* end = net_format_text(buffer, buffer + buffer_size, *go);
+	return end ? end - buffer : 0;
+}
+
+size_t DeserializeGameObjectAsText(GameObject* go, const char* buffer, size_t buffer_size)
+{
+	const char* end = net_parse_text(buffer, buffer + buffer_size, *go);
+	return end ? end - buffer : 0;
+}
+
+// Second option: Serialize as binary
+size_t SerializeGameObjectAsBytes(const GameObject* go, char* buffer, size_t buffer_size)
+{
+	return net_encode(*go, buffer, buffer_size);
+}
+
+size_t DeserializeGameObjectAsBytes(GameObject* go, const char* buffer, size_t buffer_size)
+{
+	return net_decode(*go, buffer, buffer_size);
+}
+
+// Third option: binary, but with small numbers taking fewer bytes.
+// Often beats the string version on size without any text formatting.
+size_t SerializeGameObjectAsVarints(const GameObject* go, char* buffer, size_t buffer_size)
+{
+	OutByteStream stream(buffer, buffer_size);
+	if (!net_write_compact(stream, *go)) return 0;
+	return stream.size();
+}
+
+size_t DeserializeGameObjectAsVarints(GameObject* go, const char* buffer, size_t buffer_size)
+{
+	InByteStream stream(buffer, buffer_size);
+	if (!net_read_compact(stream, *go)) return 0;
+	return stream.position();
+}
+
+// Fourth option: quantized and bit-packed. Smallest and fixed-size,
+// but values outside the declared ranges are clamped.
+size_t SerializeGameObjectQuantized(const GameObject* go, char* buffer, size_t buffer_size)
+{
+	BitWriter writer(buffer, buffer_size);
+	if (!net_write_quantized(writer, *go)) return 0;
+	return writer.Finish();
+}
+
+size_t DeserializeGameObjectQuantized(GameObject* go, const char* buffer, size_t buffer_size)
+{
+	BitReader reader(buffer, buffer_size);
+	if (!net_read_quantized(reader, *go)) return 0;
+	return reader.BytesRead();
+}
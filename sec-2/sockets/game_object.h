@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stddef.h>
+#include "net_fields.h"
+#include "quantize.h"
+
+class GameObject {
+public:
+	// Note that it's not easy to determine
+	// how a specific memory layout within
+	// a class will map to binary.
+
+	// Importantly, especially due to alignment,
+	// the same class could look different in
+	// binary on two different systems.
+	int x;
+	int y;
+	int z;
+	int xVel;
+	int yVel;
+	int zVel;
+
+	// Virtual functions are (basically) function pointers,
+	// so they affect the size of an object and make
+	// doing a simple memcpy() impossible.
+	virtual ~GameObject() = default;
+
+	virtual void Update(float dt) {
+		x++;
+		y++;
+	}
+
+	int GetX() {
+		return x;
+	}
+
+	void* sprite;
+};
+
+// The networked fields of a GameObject, declared once. Everything
+// below -- binary encode/decode, the stream operators, sizes and
+// diffs -- is generated from this list (see net_fields.h).
+template <>
+struct NetFields<GameObject> {
+	static constexpr auto fields = std::make_tuple(
+		NET_FIELD(GameObject, x),
+		NET_FIELD(GameObject, y),
+		NET_FIELD(GameObject, z),
+		NET_FIELD(GameObject, xVel),
+		NET_FIELD(GameObject, yVel),
+		NET_FIELD(GameObject, zVel));
+};
+
+// Ranges for bit-packing a GameObject (see quantize.h). Positions are
+// whole world units within +/-65536, velocities within +/-1024: 17
+// and 11 bits instead of 32.
+template <>
+struct NetQuantization<GameObject> {
+	static constexpr auto fields = std::make_tuple(
+		NET_QUANTIZED(GameObject, x, -65536, 65535, 1),
+		NET_QUANTIZED(GameObject, y, -65536, 65535, 1),
+		NET_QUANTIZED(GameObject, z, -65536, 65535, 1),
+		NET_QUANTIZED(GameObject, xVel, -1024, 1023, 1),
+		NET_QUANTIZED(GameObject, yVel, -1024, 1023, 1),
+		NET_QUANTIZED(GameObject, zVel, -1024, 1023, 1));
+};
+
+// The encodings compared in main.cpp and serialization_bench.cpp.
+// Each returns the bytes written or read, or 0 if the buffer was too
+// small (or, when reading, the message was truncated or malformed).
+size_t SerializeGameObjectAsString(const GameObject* go, char* buffer, size_t buffer_size);
+size_t DeserializeGameObjectAsString(GameObject* go, const char* buffer, size_t buffer_size);
+size_t SerializeGameObjectAsText(const GameObject* go, char* buffer, size_t buffer_size);
+size_t DeserializeGameObjectAsText(GameObject* go, const char* buffer, size_t buffer_size);
+size_t SerializeGameObjectAsBytes(const GameObject* go, char* buffer, size_t buffer_size);
+size_t DeserializeGameObjectAsBytes(GameObject* go, const char* buffer, size_t buffer_size);
+size_t SerializeGameObjectAsVarints(const GameObject* go, char* buffer, size_t buffer_size);
+size_t DeserializeGameObjectAsVarints(GameObject* go, const char* buffer, size_t buffer_size);
+size_t SerializeGameObjectQuantized(const GameObject* go, char* buffer, size_t buffer_size);
+size_t DeserializeGameObjectQuantized(GameObject* go, const char* buffer, size_t buffer_size);
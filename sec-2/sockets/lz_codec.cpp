@@ -0,0 +1,289 @@
+#include "lz_codec.h"
+#include <string.h>
+#include "wire_endian.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static const size_t kMinMatch = 4;
+static const size_t kMaxOffset = 65535;
+// As in LZ4: the last bytes are always literals, and no match starts
+// in the last kMatchSearchMargin bytes. Matches are found with
+// 8-byte loads, which then never run off the end.
+static const size_t kLastLiterals = 5;
+static const size_t kMatchSearchMargin = 12;
+
+static const int kHashBits = 12;
+
+static inline uint32_t hash_sequence(uint32_t sequence)
+{
+  return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+static inline int count_trailing_zeros(uint64_t value)
+{
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, value);
+  return (int)index;
+#else
+  return __builtin_ctzll(value);
+#endif
+}
+
+// How far p and match agree, stopping at limit.
+static inline size_t match_length(const uint8_t* p, const uint8_t* match, const uint8_t* limit)
+{
+  const uint8_t* start = p;
+  while (p + 8 <= limit)
+  {
+    uint64_t diff = load_le<uint64_t>((const char*)p) ^ load_le<uint64_t>((const char*)match);
+    if (diff != 0) return (p - start) + (count_trailing_zeros(diff) >> 3);
+    p += 8;
+    match += 8;
+  }
+  while (p < limit && *p == *match)
+  {
+    p++;
+    match++;
+  }
+  return p - start;
+}
+
+// A count of 15 or more continues in 255-valued bytes.
+static inline uint8_t* write_extra_length(uint8_t* op, size_t extra)
+{
+  for (; extra >= 255; extra -= 255) *op++ = 255;
+  *op++ = (uint8_t)extra;
+  return op;
+}
+
+static inline bool read_extra_length(const uint8_t*& ip, const uint8_t* iend, size_t& count)
+{
+  uint8_t byte;
+  do
+  {
+    if (ip == iend) return false;
+    byte = *ip++;
+    count += byte;
+  } while (byte == 255);
+  return true;
+}
+
+// Literal run, then (when match_len != 0) the match. False if it
+// doesn't fit.
+static bool write_sequence(uint8_t*& op, uint8_t* oend, const uint8_t* literals, const uint8_t* literals_end,
+                           size_t num_literals, size_t offset, size_t match_len)
+{
+  size_t extra_match = match_len ? match_len - kMinMatch : 0;
+  size_t needed = 1 + num_literals + num_literals / 255 + 1;
+  if (match_len) needed += 2 + extra_match / 255 + 1;
+  if (needed > (size_t)(oend - op)) return false;
+
+  uint8_t* token = op++;
+  *token = (uint8_t)((num_literals < 15 ? num_literals : 15) << 4);
+  if (num_literals >= 15) op = write_extra_length(op, num_literals - 15);
+  // Short runs are copied as one 16-byte block when both buffers have
+  // the room; the extra bytes are overwritten by what follows.
+  if (num_literals <= 16 && literals_end - literals >= 16 && oend - op >= 16)
+    memcpy(op, literals, 16);
+  else if (num_literals)
+    memcpy(op, literals, num_literals);
+  op += num_literals;
+  if (match_len == 0) return true;
+
+  *token |= (uint8_t)(extra_match < 15 ? extra_match : 15);
+  store_le((char*)op, (uint16_t)offset);
+  op += 2;
+  if (extra_match >= 15) op = write_extra_length(op, extra_match - 15);
+  return true;
+}
+
+size_t lz_compress(const char* data, size_t len, char* out, size_t out_size)
+{
+  const uint8_t* src = (const uint8_t*)data;
+  const uint8_t* end = src + len;
+  const uint8_t* anchor = src;
+  uint8_t* op = (uint8_t*)out;
+  uint8_t* oend = op + out_size;
+
+  // Positions are stored as 32 bits.
+  if (len > UINT32_MAX) return 0;
+
+  if (len > kMatchSearchMargin)
+  {
+    const uint8_t* search_limit = end - kMatchSearchMargin;
+    const uint8_t* match_limit = end - kLastLiterals;
+    uint32_t table[1 << kHashBits];
+    memset(table, 0, sizeof(table));
+
+    const uint8_t* ip = src + 1;
+    while (ip < search_limit)
+    {
+      uint32_t sequence = load_le<uint32_t>((const char*)ip);
+      uint32_t h = hash_sequence(sequence);
+      const uint8_t* match = src + table[h];
+      table[h] = (uint32_t)(ip - src);
+      if (match >= ip || (size_t)(ip - match) > kMaxOffset || load_le<uint32_t>((const char*)match) != sequence)
+      {
+        // Skip ahead faster the longer nothing has matched, so
+        // incompressible data costs little.
+        ip += 1 + ((ip - anchor) >> 6);
+        continue;
+      }
+
+      while (ip > anchor && match > src && ip[-1] == match[-1])
+      {
+        ip--;
+        match--;
+      }
+      size_t match_len = kMinMatch + match_length(ip + kMinMatch, match + kMinMatch, match_limit);
+      if (!write_sequence(op, oend, anchor, end, ip - anchor, ip - match, match_len)) return 0;
+      ip += match_len;
+      anchor = ip;
+      if (ip < search_limit)
+        table[hash_sequence(load_le<uint32_t>((const char*)ip - 2))] = (uint32_t)(ip - 2 - src);
+    }
+  }
+
+  if (!write_sequence(op, oend, anchor, end, end - anchor, 0, 0)) return 0;
+  return op - (uint8_t*)out;
+}
+
+// Copies a match of len bytes from offset back. Overlapping matches
+// (offset < len) repeat the last offset bytes, e.g. a run of zeros is
+// offset 1. Writes up to 15 bytes past op + len when room allows, to
+// copy in whole 8- and 16-byte chunks.
+static inline void copy_match(uint8_t* op, size_t offset, size_t len, const uint8_t* oend)
+{
+  const uint8_t* match = op - offset;
+  uint8_t* end = op + len;
+  if ((size_t)(oend - op) < len + 15)
+  {
+    for (; op < end; op++, match++) *op = *match;
+    return;
+  }
+
+  if (offset >= 16)
+  {
+    for (; op < end; op += 16, match += 16) memcpy(op, match, 16);
+    return;
+  }
+
+  if (offset < 8)
+  {
+    // Any multiple of the offset repeats the same pattern; write the
+    // first one of at least 8 bytewise, then copy 8 at a time from
+    // that far back.
+    size_t step = offset * ((8 + offset - 1) / offset);
+    size_t head = step < len ? step : len;
+    for (size_t i = 0; i < head; i++) op[i] = match[i];
+    op += head;
+    match = op - step;
+  }
+  for (; op < end; op += 8, match += 8) memcpy(op, match, 8);
+}
+
+bool lz_decompress(const char* data, size_t len, char* out, size_t out_size)
+{
+  const uint8_t* ip = (const uint8_t*)data;
+  const uint8_t* iend = ip + len;
+  uint8_t* op = (uint8_t*)out;
+  uint8_t* const obase = op;
+  uint8_t* const oend = op + out_size;
+
+  while (ip < iend)
+  {
+    uint8_t token = *ip++;
+    size_t num_literals = token >> 4;
+
+    if (num_literals != 15 && iend - ip >= 32 && oend - op >= 32)
+    {
+      // The common case, as in LZ4: under 15 literals and a match of
+      // under 19 bytes, well clear of both ends. Fixed-size copies
+      // cover it, with no loops or length-dependent branches.
+      memcpy(op, ip, 16);
+      ip += num_literals;
+      op += num_literals;
+      size_t offset = load_le<uint16_t>((const char*)ip);
+      size_t match_len = token & 15;
+      if (match_len != 15 && offset >= 8 && offset <= (size_t)(op - obase))
+      {
+        ip += 2;
+        const uint8_t* match = op - offset;
+        memcpy(op, match, 8);
+        memcpy(op + 8, match + 8, 8);
+        memcpy(op + 16, match + 16, 2);
+        op += match_len + kMinMatch;
+        continue;
+      }
+    }
+    else
+    {
+      if (num_literals == 15 && !read_extra_length(ip, iend, num_literals)) return false;
+      if (num_literals > (size_t)(iend - ip) || num_literals > (size_t)(oend - op)) return false;
+      if (num_literals) memcpy(op, ip, num_literals);
+      ip += num_literals;
+      op += num_literals;
+
+      // Only the last sequence ends after its literals.
+      if (ip == iend) return op == oend;
+    }
+
+    if (iend - ip < 2) return false;
+    size_t offset = load_le<uint16_t>((const char*)ip);
+    ip += 2;
+    if (offset == 0 || offset > (size_t)(op - obase)) return false;
+
+    size_t match_len = token & 15;
+    if (match_len == 15 && !read_extra_length(ip, iend, match_len)) return false;
+    match_len += kMinMatch;
+    if (match_len > (size_t)(oend - op)) return false;
+    copy_match(op, offset, match_len, oend);
+    op += match_len;
+  }
+  return false;
+}
+
+size_t pack_payload(const char* data, size_t len, char* out, size_t out_size, size_t threshold)
+{
+  if (out_size < packed_payload_bound(len)) return 0;
+
+  if (len >= threshold)
+  {
+    size_t header = 1 + varint_size(len);
+    // Only keep the result if it beats sending the payload as is.
+    size_t compressed = len > header ? lz_compress(data, len, out + header, len - header) : 0;
+    if (compressed != 0)
+    {
+      out[0] = (char)kFrameCompressed;
+      varint_encode(len, out + 1);
+      return header + compressed;
+    }
+  }
+
+  out[0] = 0;
+  memcpy(out + 1, data, len);
+  return 1 + len;
+}
+
+bool unpack_payload(ByteSpan packet, char* scratch, size_t scratch_size, ByteSpan& payload)
+{
+  if (packet.size == 0) return false;
+  uint8_t flags = (uint8_t)packet.data[0];
+  if (flags & ~kFrameCompressed) return false;
+  if (!(flags & kFrameCompressed))
+  {
+    payload = ByteSpan{ packet.data + 1, packet.size - 1 };
+    return true;
+  }
+
+  uint64_t size = 0;
+  size_t used = varint_decode(packet.data + 1, packet.size - 1, &size);
+  if (used == 0 || size > scratch_size) return false;
+  size_t header = 1 + used;
+  if (!lz_decompress(packet.data + header, packet.size - header, scratch, (size_t)size)) return false;
+  payload = ByteSpan{ scratch, (size_t)size };
+  return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bytestring.h"
+#include "varint.h"
+
+// LZ compression
+// ==============
+// A small LZ77 codec in the LZ4 mould: no entropy coding, just
+// literal runs and back-references, so decoding is mostly memcpy.
+// Full snapshots (long runs of similar objects) and big LIST requests
+// (digits and spaces) shrink a lot for very little CPU.
+//
+// Block format, a series of sequences:
+//
+//     uint8   token: literal count (high 4 bits), match length - 4
+//             (low 4 bits); 15 means "plus the bytes that follow"
+//     ...     255-valued bytes then one below 255, adding to a count
+//             of 15
+//     ...     the literals
+//     uint16  match offset back from the write position, 1..65535
+//     ...     extra match length bytes, as for the literal count
+//
+// The last sequence is literals only: its offset and match length
+// are left off. Blocks don't record their uncompressed size; the
+// caller sends it alongside.
+
+// Largest compressed size for len bytes of input.
+inline size_t lz_compress_bound(size_t len) { return len + len / 255 + 16; }
+
+// Compresses len bytes into out. Returns the compressed size, or 0 if
+// it wouldn't fit in out_size -- pass out_size < len to only get a
+// result that actually saves space.
+size_t lz_compress(const char* data, size_t len, char* out, size_t out_size);
+
+// Decompresses a whole block that must expand to exactly out_size
+// bytes. Returns false for malformed or hostile input (bad offsets,
+// lengths that overrun either buffer) without reading or writing out
+// of bounds.
+bool lz_decompress(const char* data, size_t len, char* out, size_t out_size);
+
+// Compressed frames
+// =================
+// When both ends turn compression on, each frame payload starts with a
+// flag byte:
+//
+//     uint8   flags (kFrameCompressed)
+//     varint  uncompressed size, if compressed
+//     ...     the payload, or its LZ block
+//
+// Payloads under the threshold, and those that don't get any smaller,
+// go as they are, so small messages only pay the flag byte.
+
+const uint8_t kFrameCompressed = 1 << 0;
+const size_t kDefaultCompressionThreshold = 256;
+
+inline size_t packed_payload_bound(size_t len) { return 1 + kMaxVarintBytes + len; }
+
+// Writes the flagged form of data into out (at least
+// packed_payload_bound(len) bytes). Returns the bytes written.
+size_t pack_payload(const char* data, size_t len, char* out, size_t out_size, size_t threshold);
+
+// Reverses pack_payload(). payload points into packet when it wasn't
+// compressed, otherwise into scratch. Returns false if the packet is
+// malformed or would expand past scratch_size.
+bool unpack_payload(ByteSpan packet, char* scratch, size_t scratch_size, ByteSpan& payload);
@@ -3,9 +3,30 @@
 #include <string>
 #include <time.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
 
 #include "socklib.h"
+#include "bytestream.h"
+#include "net_fields.h"
+#include "game_object.h"
+#include "snapshot.h"
+#include "quantize.h"
+#include "soa_codec.h"
+#include "framing.h"
+#include "net_registry.h"
+#include "net_schema.h"
+#include "crc32c.h"
+#include "range_coder.h"
+#include "reliable_udp.h"
+#include "datagram_packer.h"
+#include "udp_client.h"
 #include "defer.h"
+#include "memory_resources.h"
 
 void print_as_bytes(char* object, size_t bytes) {
 	for (int i = 0; i < bytes; i++) {
@@ -15,37 +36,6 @@ void print_as_bytes(char* object, size_t bytes) {
 	printf("\n");
 }
 
-class GameObject {
-public:
-	// Note that it's not easy to determine
-	// how a specific memory layout within
-	// a class will map to binary.
-
-	// Importantly, especially due to alignment,
-	// the same class could look different in
-	// binary on two different systems.
-	int x;
-	int y;
-	int z;
-	int xVel;
-	int yVel;
-	int zVel;
-
-	// Virtual functions are (basically) function pointers,
-	// so they affect the size of an object and make
-	// doing a simple memcpy() impossible.
-	virtual void Update(float dt) {
-		x++;
-		y++;
-	}
-
-	int GetX() {
-		return x;
-	}
-
-	void* sprite;
-};
-
 // Member functions are essentially just this:
 int GameObject_GetX(GameObject* ths);
 
@@ -56,91 +46,6 @@ struct GameObject_Struct {
 	void (*Update)(GameObject_Struct*, float);
 };
 
-// One option -- serialize to a string.
-size_t SerializeGameObjectAsString(const GameObject* go, char* buffer, size_t buffer_size)
-{
-	std::stringstream go_ss;
-
-	// Need spaces (or other delimiters) between each value
-	// Because otherwise "100" could mean either 100 or 1, 0, 0.
-	// So spaces tell us when one number has ended.
-	go_ss << go->x << " "
-		<< go->y << " "
-		<< go->z << " "
-		<< go->xVel << " "
-		<< go->yVel << " "
-		<< go->zVel;
-	std::string go_str = go_ss.str();
-
-	size_t bytes_copied = 0;
-	// Could replace the for loop below with strncpy(buffer, go_str.c_str(), buffer_size);
-	for (int i = 0; i < go_str.size() && i < buffer_size; i++) {
-		buffer[i] = go_str[i];
-		bytes_copied++;
-	}
-
-	return bytes_copied;
-}
-
-template <typename T>
-size_t copy_to_buffer(char* buffer, T* object, size_t buffer_size)
-{
-	if (sizeof(T) > buffer_size) return 0;
-	char* object_as_bytes = (char*)object;
-	for (int i = 0; i < sizeof(T); i++) {
-		buffer[i] = object_as_bytes[i];
-	}
-	return sizeof(T);
-}
-
-template <typename T>
-size_t copy_from_buffer(const char* buffer, T* object, size_t buffer_size)
-{
-	if (sizeof(T) > buffer_size) return 0;
-	char* object_as_bytes = (char*)object;
-	for (int i = 0; i < sizeof(T); i++) {
-		object_as_bytes[i] = buffer[i];
-	}
-	return sizeof(T);
-}
-
-size_t copy_to_buffer(char* buffer, int* object, size_t buffer_size)
-{
-	if (buffer_size < sizeof(int)) return 0;
-	char* object_as_bytes = (char*)object;
-	for (int i = 0; i < sizeof(int); i++) {
-		buffer[i] = object_as_bytes[i];
-	}
-	return sizeof(int);
-}
-
-// Second option: Serialize as binary
-size_t SerializeGameObjectAsBytes(const GameObject* go, char* buffer, size_t buffer_size)
-{
-	size_t bytes_written = 0;
-	bytes_written += copy_to_buffer(&buffer[bytes_written], &go->x, buffer_size - bytes_written);
-	bytes_written += copy_to_buffer(&buffer[bytes_written], &go->y, buffer_size - bytes_written);
-	bytes_written += copy_to_buffer(&buffer[bytes_written], &go->z, buffer_size - bytes_written);
-	bytes_written += copy_to_buffer(&buffer[bytes_written], &go->xVel, buffer_size - bytes_written);
-	bytes_written += copy_to_buffer(&buffer[bytes_written], &go->yVel, buffer_size - bytes_written);
-	bytes_written += copy_to_buffer(&buffer[bytes_written], &go->zVel, buffer_size - bytes_written);
-	return bytes_written;
-}
-
-size_t DeserializeGameObjectAsBytes(GameObject* go, char* buffer, size_t buffer_size)
-{
-	size_t bytes_read = 0;
-
-	bytes_read += copy_from_buffer(&buffer[bytes_read], &go->x, buffer_size - bytes_read);
-	bytes_read += copy_from_buffer(&buffer[bytes_read], &go->y, buffer_size - bytes_read);
-	bytes_read += copy_from_buffer(&buffer[bytes_read], &go->z, buffer_size - bytes_read);
-	bytes_read += copy_from_buffer(&buffer[bytes_read], &go->xVel, buffer_size - bytes_read);
-	bytes_read += copy_from_buffer(&buffer[bytes_read], &go->yVel, buffer_size - bytes_read);
-	bytes_read += copy_from_buffer(&buffer[bytes_read], &go->zVel, buffer_size - bytes_read);
-
-	return bytes_read;
-}
-
 /*
 * // To send a gameobject
 * GameObject go; // Pretend this data in it
@@ -157,54 +62,8 @@ size_t DeserializeGameObjectAsBytes(GameObject* go, char* buffer, size_t buffer_
 * DeserializeGameObjectAsBytes(&go, buffer, nbytes_recvd);
 */
 
-class OutByteStream {
-public:
-	OutByteStream() {
-		buffer = new char[4096];
-		buffer_size = 4096;
-		write_head = 0;
-	}
-
-	~OutByteStream() {
-		delete[] buffer;
-	}
-
-	// Start here...
-	bool Insert(int x) {
-		if (bytes_remaining() < sizeof(int)) return false;
-		char* object_as_bytes = (char*)x;
-		for (int i = 0; i < sizeof(int); i++) {
-			buffer[i] = object_as_bytes[i];
-		}
-		return true;
-	}
-
-	bool Insert(const GameObject& go) {
-		if (bytes_remaining() < sizeof(GameObject)) return false;
-		return Insert(go.x)
-			&& Insert(go.y)
-			&& Insert(go.z)
-			&& Insert(go.xVel)
-			&& Insert(go.yVel)
-			&& Insert(go.zVel);
-	}
-
-	char* data() { return buffer; }
-	size_t size() { return write_head; }
-	size_t bytes_remaining() { return buffer_size - write_head; }
-
-	// ...Build up to here ...
-	// Psst... Make this length-prefixed
-	void Insert(char* x);
-	void Insert(std::vector<int> x);
-
-private:
-	char* buffer;
-	size_t buffer_size;
-	size_t write_head;
-};
-
-OutByteStream& operator<<(OutByteStream& stream, int x)
+template <typename T, typename = std::enable_if_t<std::is_arithmetic<T>::value>>
+OutByteStream& operator<<(OutByteStream& stream, T x)
 {
 	stream.Insert(x);
 	return stream;
@@ -213,26 +72,29 @@ OutByteStream& operator<<(OutByteStream& stream, int x)
 // Could put this in GameObject.h/.cpp
 OutByteStream& operator<<(OutByteStream& stream, const GameObject& go)
 {
-	stream << go.x << go.y << go.z << go.xVel << go.yVel << go.zVel;
+	net_write(stream, go);
+	return stream;
+}
+
+InByteStream& operator>>(InByteStream& stream, GameObject& go)
+{
+	net_read(stream, go);
 	return stream;
 }
 
 void SendGameObject(const GameObject* go, Socket& socket) {
-	OutByteStream stream;
-	stream.Insert(go->x);
-	stream.Insert(go->y);
-	stream.Insert(go->z);
-	stream.Insert(go->xVel);
-	stream.Insert(go->yVel);
-	stream.Insert(go->zVel);
-	socket.Send(stream.data(), stream.size());
+	// Lives on the stack, so sending doesn't allocate.
+	InlineOutByteStream<64> stream;
+	stream << *go;
+	if (!stream.ok()) return;
+	socket.SendAll(stream.span());
 }
 
 /*
 * Example use:
 * 
 * void SendGameObject(const GameObject* go, Socket& sock) {
-*	OutByteStream s;
+*	InlineOutByteStream<64> s;
 *	s.Insert(go->x);
 *	s.Insert(go->y);
 *	s.Insert(go->z);
@@ -243,7 +105,7 @@ void SendGameObject(const GameObject* go, Socket& socket) {
 /*
 * Example use:
 *
-* void ReadGameObject(const GameObject* go, Socket& sock) {
+* void ReadGameObject(GameObject* go, Socket& sock) {
 *	InByteStream s;
 *	char buffer[4096];
 *	int nbytes_recvd = sock.Recv(buffer, sizeof(buffer));
@@ -252,6 +114,7 @@ void SendGameObject(const GameObject* go, Socket& socket) {
 *	s.Read(go->x);
 *	s.Read(go->y);
 *	s.Read(go->z);
+*	if (!s.ok()) abort(); // Message was truncated
 * }
 */
 
@@ -287,6 +150,14 @@ void byte_demo()
 		print_as_bytes(buffer, bytes_written);
 
 	}
+
+	{
+		char buffer[4096];
+		size_t bytes_written = SerializeGameObjectAsVarints(&go, buffer, sizeof(buffer));
+		std::cout << "\n==== Game Object Serialized as Varints ====\n";
+		std::cout << "==== Size: " << bytes_written << " bytes   ====\n";
+		print_as_bytes(buffer, bytes_written);
+	}
 }
 
 float clocks_to_secs(clock_t clocks) {
@@ -297,6 +168,623 @@ float time_now() {
 	return clocks_to_secs(clock());
 }
 
+// Rough timing of fixed-width vs. varint encoding for a typical,
+// mostly-idle object (small coordinates, zero velocity).
+void varint_timing_demo()
+{
+	const int iterations = 1000000;
+	GameObject go;
+	go.x = 120;
+	go.y = -45;
+	go.z = 3;
+	go.xVel = 0;
+	go.yVel = 0;
+	go.zVel = 0;
+
+	char buffer[64];
+	size_t fixed_bytes = 0;
+	size_t varint_bytes = 0;
+	// Summing what we decode keeps the optimizer from skipping the work.
+	long long checksum = 0;
+	GameObject out;
+
+	float start = time_now();
+	for (int i = 0; i < iterations; i++) {
+		go.x = i & 0xff;
+		fixed_bytes += SerializeGameObjectAsBytes(&go, buffer, sizeof(buffer));
+		DeserializeGameObjectAsBytes(&out, buffer, sizeof(buffer));
+		checksum += out.x;
+	}
+	float fixed_secs = time_now() - start;
+
+	start = time_now();
+	for (int i = 0; i < iterations; i++) {
+		go.x = i & 0xff;
+		size_t n = SerializeGameObjectAsVarints(&go, buffer, sizeof(buffer));
+		varint_bytes += n;
+		DeserializeGameObjectAsVarints(&out, buffer, n);
+		checksum -= out.x;
+	}
+	float varint_secs = time_now() - start;
+
+	std::cout << "\n==== Fixed vs. Varint (" << iterations << " round trips) ====\n";
+	std::cout << "Fixed:  " << (double)fixed_bytes / iterations << " bytes/object, "
+		<< fixed_secs * 1e9 / iterations << " ns/object\n";
+	std::cout << "Varint: " << (double)varint_bytes / iterations << " bytes/object, "
+		<< varint_secs * 1e9 / iterations << " ns/object\n";
+	if (checksum != 0) std::cout << "Round trip mismatch!\n";
+}
+
+// A server with a few hundred mostly idle objects: compare sending
+// every object in full each tick with sending deltas against the
+// last snapshot the client acknowledged.
+void snapshot_demo()
+{
+	const uint32_t num_objects = 500;
+	const uint32_t num_ticks = 60;
+	std::vector<GameObject> world(num_objects);
+	for (uint32_t i = 0; i < num_objects; i++) {
+		world[i].x = i;
+		world[i].y = 0;
+		world[i].z = 0;
+		world[i].xVel = 0;
+		world[i].yVel = 0;
+		world[i].zVel = 0;
+	}
+
+	ClientSnapshotHistory<GameObject> client_history;
+	SnapshotRing<GameObject> client_received;
+	Snapshot<GameObject> current;
+	Snapshot<GameObject> decoded;
+	// Each tick's messages come out of a pool, and NextFrame() throws
+	// them all away at once.
+	init_pools({ 64 * 1024 });
+	FrameArena arena(64 * 1024);
+	size_t full_bytes = 0;
+	size_t delta_bytes = 0;
+
+	for (uint32_t tick = 0; tick < num_ticks; tick++) {
+		arena.NextFrame();
+		OutByteStream stream(&arena, 16 * 1024);
+
+		// Only a handful of objects move each tick.
+		for (int i = 0; i < 10; i++) {
+			GameObject& go = world[rand() % num_objects];
+			go.xVel = rand() % 3 - 1;
+			go.x += go.xVel;
+		}
+
+		current.Clear(tick);
+		for (uint32_t i = 0; i < num_objects; i++)
+			current.Add(i, world[i]);
+
+		stream.clear();
+		write_snapshot_delta(stream, current, (const Snapshot<GameObject>*)nullptr);
+		full_bytes += stream.size();
+
+		stream.clear();
+		write_snapshot_delta(stream, current, client_history.Baseline());
+		client_history.Sent(current);
+		delta_bytes += stream.size();
+
+		// Pretend every fourth packet is lost on the way.
+		if (tick % 4 == 3) continue;
+		InByteStream in(stream.span());
+		if (read_snapshot_delta(in, client_received, decoded)) {
+			client_received.Record(decoded);
+			client_history.Ack(decoded.sequence);
+		}
+	}
+
+	std::cout << "\n==== Snapshots (" << num_objects << " objects, " << num_ticks << " ticks) ====\n";
+	std::cout << "Full:  " << full_bytes / num_ticks << " bytes/tick\n";
+	std::cout << "Delta: " << delta_bytes / num_ticks << " bytes/tick\n";
+	arena.NextFrame();
+	std::cout << "Scratch: " << arena.HighWaterMark() << " bytes/tick at most, from a "
+		<< arena.Capacity() << "-byte pool\n";
+}
+
+// Quantized GameObjects, and a batch of float positions quantized to
+// a tenth of a unit: how small, how fast, and how far off.
+void quantize_demo()
+{
+	GameObject go;
+	go.x = 1200;
+	go.y = -450;
+	go.z = 30;
+	go.xVel = 5;
+	go.yVel = -2;
+	go.zVel = 0;
+
+	char buffer[64];
+	size_t bytes_written = SerializeGameObjectQuantized(&go, buffer, sizeof(buffer));
+	std::cout << "\n==== Game Object Quantized (" << net_quantized_bits<GameObject>() << " bits) ====\n";
+	std::cout << "==== Size: " << bytes_written << " bytes, vs. " << net_size<GameObject>() << " fixed ====\n";
+	print_as_bytes(buffer, bytes_written);
+
+	const size_t count = 1 << 20;
+	const Quantization position{ -4096.0f, 4096.0f, 0.1f };
+	std::vector<float> positions(count);
+	for (size_t i = 0; i < count; i++)
+		positions[i] = (float)(rand() % 8192000) / 1000.0f - 4096.0f;
+	std::vector<uint32_t> quantized(count);
+	std::vector<float> restored(count);
+
+	float start = time_now();
+	quantize_array(positions.data(), quantized.data(), count, position);
+	dequantize_array(quantized.data(), restored.data(), count, position);
+	float secs = time_now() - start;
+
+	float max_error = 0;
+	for (size_t i = 0; i < count; i++)
+		max_error = std::max(max_error, std::abs(restored[i] - positions[i]));
+	std::cout << "\n==== Quantized positions (" << count << " floats, " << position.Bits() << " bits each) ====\n";
+	std::cout << "Round trip: " << secs * 1e9 / count << " ns/value\n";
+	std::cout << "Max error:  " << max_error << " (bound " << position.MaxError() << ")\n";
+}
+
+// Whole-world encoding: one object at a time through pointers, versus
+// the same state kept as columns (see soa_codec.h).
+void soa_demo()
+{
+	const size_t num_objects = 100000;
+	const int iterations = 20;
+	std::vector<GameObject> storage(num_objects);
+	std::vector<GameObject*> objects;
+	for (size_t i = 0; i < num_objects; i++) {
+		GameObject& go = storage[i];
+		go.x = (int)i * 4 + rand() % 4;
+		go.y = rand() % 64;
+		go.z = 0;
+		go.xVel = rand() % 3 - 1;
+		go.yVel = 0;
+		go.zVel = 0;
+		objects.push_back(&go);
+	}
+
+	std::pmr::monotonic_buffer_resource scratch;
+	OutByteStream stream(&scratch, num_objects * 32);
+	bool ok = true;
+
+	std::vector<GameObject> decoded_objects(num_objects);
+	float start = time_now();
+	for (int it = 0; it < iterations; it++) {
+		stream.clear();
+		for (const GameObject* go : objects)
+			net_write_compact(stream, *go);
+		InByteStream in(stream.span());
+		for (GameObject& out : decoded_objects)
+			ok = net_read_compact(in, out) && ok;
+	}
+	float per_object_secs = time_now() - start;
+	size_t per_object_bytes = stream.size();
+	for (size_t i = 0; i < num_objects; i++)
+		ok = ok && net_diff(decoded_objects[i], storage[i]) == 0;
+
+	// Kept as columns, the world encodes without touching the objects.
+	NetColumns<GameObject> columns;
+	NetColumns<GameObject> decoded;
+	start = time_now();
+	net_gather_columns(objects.data(), objects.size(), columns);
+	float gather_secs = time_now() - start;
+
+	start = time_now();
+	for (int it = 0; it < iterations; it++) {
+		stream.clear();
+		write_columns(stream, columns);
+		InByteStream in(stream.span());
+		ok = read_columns(in, decoded, num_objects) && ok;
+	}
+	float column_secs = time_now() - start;
+	for (size_t c = 0; c < NetColumns<GameObject>::kNumColumns; c++)
+		ok = ok && decoded.columns[c] == columns.columns[c];
+
+	std::cout << "\n==== World encode + decode (" << num_objects << " objects) ====\n";
+	std::cout << "Per object (varints): " << (double)per_object_bytes / num_objects << " bytes/object, "
+		<< per_object_secs * 1e9 / iterations / num_objects << " ns/object\n";
+	std::cout << "Columns:              " << (double)stream.size() / num_objects << " bytes/object, "
+		<< column_secs * 1e9 / iterations / num_objects << " ns/object\n";
+	std::cout << "(Gathering objects into columns: " << gather_secs * 1e9 / num_objects << " ns/object)"
+		<< (ok ? "" : " (MISMATCH)") << "\n";
+}
+
+// TCP doesn't keep message boundaries: three messages can arrive as
+// any split of their bytes. Length prefixes (see framing.h) put the
+// boundaries back.
+void framing_demo()
+{
+	InlineOutByteStream<256> wire;
+	const char* messages[] = { "LIST 1 2 3", "HELLO", "A longer message that spans reads" };
+	for (const char* message : messages)
+		write_frame(wire, message, strlen(message));
+
+	// Pretend the socket delivered the bytes in awkward pieces: the
+	// first read ends mid-frame, the second holds the rest of two.
+	FrameReader reader(1024);
+	size_t splits[] = { 7, wire.size() - 7 };
+	size_t offset = 0;
+	std::cout << "\n==== Framing (" << wire.size() << " bytes in 2 reads) ====\n";
+	for (size_t split : splits) {
+		reader.Append(wire.data() + offset, split);
+		offset += split;
+		ByteSpan frame;
+		while (reader.Next(frame))
+			std::cout << "Frame: \"" << std::string(frame.data, frame.size) << "\"\n";
+	}
+}
+
+// Replicating 10k objects by network id: the client applies an update
+// to the objects it already has, instead of rebuilding its list.
+void registry_demo()
+{
+	const int num_objects = 10000;
+	NetRegistry<GameObject> server;
+	NetRegistry<GameObject> client;
+	std::vector<uint32_t> ids;
+	for (int i = 0; i < num_objects; i++) {
+		uint32_t id = server.Create();
+		server.Get(id)->x = i;
+		ids.push_back(id);
+	}
+
+	std::pmr::monotonic_buffer_resource scratch;
+	OutByteStream stream(&scratch, 64 * 1024);
+	write_registry_batch(stream, server);
+	InByteStream creates(stream.span());
+	apply_registry_batch(creates, client);
+
+	// Everything moves one step along x.
+	for (uint32_t id : ids) {
+		server.Get(id)->x++;
+		server.MarkDirty(id, 1 << 0);
+	}
+	stream.clear();
+	write_registry_batch(stream, server);
+
+	// Timed over several runs of the same batch, like soa_demo: a
+	// single cold pass is mostly cache misses and clock() noise.
+	const int iterations = 200;
+	float start = time_now();
+	for (int it = 0; it < iterations; it++) {
+		InByteStream updates(stream.span());
+		apply_registry_batch(updates, client);
+	}
+	float apply_secs = (time_now() - start) / iterations;
+
+	// What run_server() does today: the whole list, in full, into a
+	// fresh object per entry, freeing the previous message's objects.
+	std::pmr::monotonic_buffer_resource full_scratch;
+	OutByteStream full_stream(&full_scratch, 64 * 1024);
+	server.ForEach([&](uint32_t, GameObject& go) { net_write(full_stream, go); });
+	std::vector<GameObject*> rebuilt;
+	rebuilt.reserve(num_objects);
+	start = time_now();
+	for (int it = 0; it < iterations; it++) {
+		for (GameObject* go : rebuilt)
+			delete go;
+		rebuilt.clear();
+		InByteStream full(full_stream.span());
+		for (int i = 0; i < num_objects; i++) {
+			GameObject* go = new GameObject;
+			net_read(full, *go);
+			rebuilt.push_back(go);
+		}
+	}
+	float rebuild_secs = (time_now() - start) / iterations;
+	for (GameObject* go : rebuilt)
+		delete go;
+
+	std::cout << "\n==== Registry (" << client.Count() << " objects, " << iterations << " runs) ====\n";
+	std::cout << "Update batch: " << stream.size() << " bytes, applied in " << apply_secs * 1e6 << " us\n";
+	std::cout << "Rebuild:      " << full_stream.size() << " bytes, rebuilt in " << rebuild_secs * 1e6 << " us\n";
+}
+
+// An older build's GameObject: 2D, with a float velocity.
+struct GameObjectV1 {
+	int x;
+	int y;
+	float xVel;
+	float yVel;
+};
+
+template <>
+struct NetFields<GameObjectV1> {
+	static constexpr auto fields = std::make_tuple(
+		NET_FIELD(GameObjectV1, x),
+		NET_FIELD(GameObjectV1, y),
+		NET_FIELD(GameObjectV1, xVel),
+		NET_FIELD(GameObjectV1, yVel));
+};
+
+// Each end sends its schema once at connect time. Matching versions
+// decode as before; an old peer's objects get mapped field by field.
+void schema_demo()
+{
+	char handshake[256];
+	OutByteStream hello(handshake, sizeof(handshake));
+	write_schema(hello, net_schema<GameObjectV1>());
+
+	NetSchema remote;
+	InByteStream hello_in(hello.span());
+	read_schema(hello_in, remote);
+	NetSchemaDecoder<GameObject> decoder;
+	decoder.SetRemote(remote);
+
+	GameObjectV1 old_go{ 10, 20, 1.5f, -2.0f };
+	char packet[64];
+	OutByteStream out(packet, sizeof(packet));
+	net_write(out, old_go);
+
+	GameObject go;
+	go.x = go.y = go.z = go.xVel = go.yVel = go.zVel = 0;
+	InByteStream in(out.span());
+	decoder.Read(in, go);
+
+	std::cout << "\n==== Schemas (" << hello.size() << " byte handshake) ====\n";
+	std::cout << "Same schema: " << (decoder.SameSchema() ? "yes" : "no") << "\n";
+	std::cout << "Decoded old object: x=" << go.x << " y=" << go.y << " z=" << go.z
+		<< " xVel=" << go.xVel << " yVel=" << go.yVel << "\n";
+}
+
+// Checksumming a typical datagram, and what a single flipped bit
+// does to it.
+void crc_demo()
+{
+	const int iterations = 1000000;
+	char packet[1204];
+	for (int i = 0; i < 1200; i++) packet[i] = (char)(i * 31);
+	OutByteStream stream(packet, sizeof(packet));
+	stream.Reserve(1200);
+	append_crc_trailer(stream);
+
+	float start = time_now();
+	uint32_t crc = 0;
+	for (int i = 0; i < iterations; i++)
+		crc ^= crc32c(packet, 1200);
+	float secs = time_now() - start;
+
+	ByteSpan payload;
+	bool intact = check_crc_trailer(stream.data(), stream.size(), payload);
+	packet[600] ^= 0x08;
+	bool corrupt = check_crc_trailer(stream.data(), stream.size(), payload);
+
+	std::cout << "\n==== CRC32C (" << (crc32c_hardware_accelerated() ? "crc32 instruction" : "software") << ") ====\n";
+	std::cout << "1200-byte packet: " << secs * 1e9 / iterations << " ns, "
+		<< 1200.0 * iterations / (secs * 1e9) << " GB/s (" << (crc & 1) << ")\n";
+	std::cout << "Intact packet accepted: " << (intact ? "yes" : "no") << "\n";
+	std::cout << "Flipped bit accepted:   " << (corrupt ? "yes" : "no") << "\n";
+}
+
+// One tick of a 1000-object world against the tick before: most
+// objects haven't moved, the rest moved by their velocity.
+void range_coder_demo()
+{
+	const size_t num_objects = 1000;
+	const int iterations = 2000;
+	std::vector<GameObject> current(num_objects), previous(num_objects), decoded(num_objects);
+	std::vector<const GameObject*> current_ptrs, previous_ptrs;
+	std::vector<GameObject*> decoded_ptrs;
+	for (size_t i = 0; i < num_objects; i++) {
+		GameObject& go = current[i];
+		go.x = rand() % 8000 - 4000;
+		go.y = rand() % 8000 - 4000;
+		go.z = rand() % 500;
+		bool moving = rand() % 10 < 3;
+		go.xVel = moving ? rand() % 41 - 20 : 0;
+		go.yVel = moving ? rand() % 41 - 20 : 0;
+		go.zVel = 0;
+		previous[i] = go;
+		previous[i].x -= go.xVel;
+		previous[i].y -= go.yVel;
+		current_ptrs.push_back(&current[i]);
+		previous_ptrs.push_back(&previous[i]);
+		decoded_ptrs.push_back(&decoded[i]);
+	}
+
+	std::vector<char> buffer(num_objects * 32);
+	std::cout << "\n==== Range-coded deltas (" << num_objects << " objects) ====\n";
+
+	// Every field bit-packed, for scale.
+	size_t quantized_bytes = (net_quantized_bits<GameObject>() * num_objects + 7) / 8;
+	std::cout << "Bit-packed, no delta: " << quantized_bytes << " bytes\n";
+
+	for (int streams : { 1, kMaxRangeStreams }) {
+		OutByteStream out(buffer.data(), buffer.size());
+		float start = time_now();
+		for (int it = 0; it < iterations; it++) {
+			out.clear();
+			write_range_coded_deltas(out, current_ptrs.data(), previous_ptrs.data(), num_objects, streams);
+		}
+		float encode_secs = time_now() - start;
+
+		bool ok = true;
+		start = time_now();
+		for (int it = 0; it < iterations; it++) {
+			InByteStream in(out.span());
+			ok = read_range_coded_deltas(in, decoded_ptrs.data(), previous_ptrs.data(), num_objects) && ok;
+		}
+		float decode_secs = time_now() - start;
+		for (size_t i = 0; i < num_objects; i++)
+			ok = ok && decoded[i].x == current[i].x && decoded[i].yVel == current[i].yVel;
+
+		double per_object = 1e9 / ((double)iterations * num_objects);
+		std::cout << streams << " stream(s): " << out.size() << " bytes, encode "
+			<< encode_secs * per_object << " ns/object, decode "
+			<< decode_secs * per_object << " ns/object" << (ok ? "" : " (MISMATCH)") << "\n";
+	}
+}
+
+// Two ReliableConnections over loopback, with a fifth of all packets
+// thrown away on arrival. Positions go unreliably, chat reliably and
+// in order, at 60 ticks a second of pretend time.
+void reliability_demo()
+{
+	SockLibInit();
+	Socket sock_a(Socket::Family::INET, Socket::Type::DGRAM);
+	Socket sock_b(Socket::Family::INET, Socket::Type::DGRAM);
+	Address addr_a("127.0.0.1", 7790);
+	Address addr_b("127.0.0.1", 7791);
+	sock_a.Bind(addr_a);
+	sock_b.Bind(addr_b);
+	sock_a.SetNonBlockingMode(true);
+	sock_b.SetNonBlockingMode(true);
+	std::unique_ptr<ReliableConnection> a(new ReliableConnection(sock_a, addr_b));
+	std::unique_ptr<ReliableConnection> b(new ReliableConnection(sock_b, addr_a));
+
+	const int num_chat = 500;
+	int chat_sent = 0, chat_received = 0, positions_received = 0;
+	bool in_order = true;
+	char packet[kMaxReliablePacketSize];
+	for (int tick = 0; tick < 600; tick++) {
+		double now = tick / 60.0;
+		if (chat_sent < num_chat) {
+			std::string line = "chat " + std::to_string(chat_sent);
+			if (a->Send(ReliableConnection::RELIABLE_ORDERED, line.data(), line.size()))
+				chat_sent++;
+		}
+		a->Send(ReliableConnection::UNRELIABLE, "position", 8);
+		a->Update(now);
+		b->Update(now);
+
+		Address src;
+		int len;
+		while ((len = sock_b.RecvFrom(packet, sizeof(packet), src)) > 0)
+			if (rand() % 5 != 0) b->ProcessPacket(packet, len, now);
+		while ((len = sock_a.RecvFrom(packet, sizeof(packet), src)) > 0)
+			if (rand() % 5 != 0) a->ProcessPacket(packet, len, now);
+
+		ReliableConnection::Message message;
+		while (b->Receive(message)) {
+			if (message.channel == ReliableConnection::UNRELIABLE) {
+				positions_received++;
+				continue;
+			}
+			in_order = in_order && std::string(message.data.data(), message.data.size()) == "chat " + std::to_string(chat_received);
+			chat_received++;
+		}
+	}
+
+	const ReliableConnection::Stats& stats = a->GetStats();
+	std::cout << "\n==== Reliable UDP (20% loss) ====\n";
+	std::cout << "Chat delivered: " << chat_received << "/" << num_chat << (in_order ? " in order" : " OUT OF ORDER") << "\n";
+	std::cout << "Positions delivered: " << positions_received << "/600\n";
+	std::cout << "Packets sent: " << stats.packets_sent << ", acked: " << stats.packets_acked
+		<< ", chat resends: " << stats.messages_resent << ", RTT " << a->Rtt() * 1000 << " ms\n";
+}
+
+// The server side of udp_client_demo: replies to each "<id> <c>"
+// with "<id> <C>", but loses some replies, sends others twice, hands
+// them back in batches in shuffled order, and has a second socket
+// send stray copies from the wrong address.
+void lossy_echo_server(Socket& sock, int drop_percent, std::atomic<bool>& stop, std::atomic<int>& requests)
+{
+	Socket rogue(Socket::Family::INET, Socket::Type::DGRAM);
+	std::mt19937 rng(48);
+	std::vector<std::pair<std::string, Address>> pending;
+	char buffer[kUdpClientMaxReply];
+	while (!stop) {
+		Address src;
+		int len = sock.RecvFrom(buffer, sizeof(buffer), src);
+		if (len > 0) {
+			requests++;
+			std::string reply(buffer, len);
+			for (char& c : reply) c = (char)toupper((unsigned char)c);
+			if ((int)(rng() % 100) >= drop_percent) pending.push_back({ reply, src });
+			if (rng() % 10 == 0) pending.push_back({ reply, src });
+			if (rng() % 10 == 0) rogue.SendTo(reply.data(), reply.size(), src);
+			if (pending.size() < 8) continue;
+		}
+		std::shuffle(pending.begin(), pending.end(), rng);
+		for (const std::pair<std::string, Address>& reply : pending)
+			sock.SendTo(reply.first.data(), reply.first.size(), reply.second);
+		pending.clear();
+	}
+}
+
+// UDPClient with IDs against a lossy server: the replies come back
+// complete and in order, and only the lost ones cost a resend. The
+// second message also has to ignore late replies to the first.
+void udp_client_demo()
+{
+	const int drop_percent = 20;
+	Address server_addr("127.0.0.1", 7793);
+	Socket server_sock(Socket::Family::INET, Socket::Type::DGRAM);
+	server_sock.Bind(server_addr);
+	server_sock.SetTimeout(0.05f);
+	std::atomic<bool> stop(false);
+	std::atomic<int> requests(0);
+	std::thread server(lossy_echo_server, std::ref(server_sock), drop_percent, std::ref(stop), std::ref(requests));
+
+	UDPClient client("127.0.0.1", 7793, true);
+	std::string message;
+	for (int i = 0; i < 1000; i++)
+		message += (char)('a' + i % 26);
+	std::string expected = message;
+	for (char& c : expected) c = (char)toupper((unsigned char)c);
+
+	std::cout << "\n==== UDP client (" << drop_percent << "% of replies lost, the rest shuffled and duplicated) ====\n";
+	for (int round = 0; round < 2; round++) {
+		requests = 0;
+		std::string result;
+		// Wall time: the client spends most of it waiting, which
+		// time_now()'s CPU clock wouldn't count.
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		int status = client.send_message_by_character(message, result);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		bool ok = status == 0 && result == expected;
+		std::cout << "Message " << round + 1 << ": " << message.size() << " characters in "
+			<< ms << " ms, " << requests << " requests (" << requests - (int)message.size()
+			<< " resent)" << (ok ? "" : " (MISMATCH)") << "\n";
+	}
+
+	stop = true;
+	server.join();
+}
+
+// A tick's worth of small per-object updates to one client: a
+// datagram each, or packed into MTU-sized ones.
+void packer_demo()
+{
+	const int ticks = 100;
+	const int messages_per_tick = 1000;
+	Socket sender(Socket::Family::INET, Socket::Type::DGRAM);
+	Socket receiver(Socket::Family::INET, Socket::Type::DGRAM);
+	Address client("127.0.0.1", 7792);
+	receiver.Bind(client);
+	receiver.SetNonBlockingMode(true);
+
+	char message[16];
+	char packet[kDefaultPackerMtu];
+	Address src;
+	memset(message, 'u', sizeof(message));
+
+	float start = time_now();
+	for (int tick = 0; tick < ticks; tick++) {
+		for (int i = 0; i < messages_per_tick; i++)
+			sender.SendTo(message, sizeof(message), client);
+		while (receiver.RecvFrom(packet, sizeof(packet), src) > 0) {}
+	}
+	float unpacked_secs = time_now() - start;
+
+	DatagramPacker packer(sender);
+	start = time_now();
+	for (int tick = 0; tick < ticks; tick++) {
+		for (int i = 0; i < messages_per_tick; i++)
+			packer.Queue(client, message, sizeof(message), i % 3);
+		packer.Flush();
+		while (receiver.RecvFrom(packet, sizeof(packet), src) > 0) {}
+	}
+	float packed_secs = time_now() - start;
+
+	const DatagramPacker::Stats& stats = packer.GetStats();
+	double per_message = 1e9 / ((double)ticks * messages_per_tick);
+	std::cout << "\n==== Datagram packing (" << messages_per_tick << " x " << sizeof(message) << "-byte messages per tick) ====\n";
+	std::cout << "One per datagram: " << messages_per_tick << " datagrams/tick, "
+		<< unpacked_secs * per_message << " ns/message\n";
+	std::cout << "Packed:           " << stats.datagrams / ticks << " datagrams/tick in "
+		<< stats.batches / ticks << " batch(es), " << packed_secs * per_message << " ns/message\n";
+}
+
 int main(int argc, char *argv[]) {
 	int x = -1;
 	unsigned int y = x;
@@ -304,6 +792,18 @@ int main(int argc, char *argv[]) {
 	x = y;
 	std::cout << x << std::endl;
 	byte_demo();
+	varint_timing_demo();
+	snapshot_demo();
+	quantize_demo();
+	soa_demo();
+	framing_demo();
+	registry_demo();
+	schema_demo();
+	crc_demo();
+	range_coder_demo();
+	reliability_demo();
+	udp_client_demo();
+	packer_demo();
 	return 0;
 
 	// Game loop structure
@@ -0,0 +1,100 @@
+#include "memory_resources.h"
+#include <stdint.h>
+
+static size_t align_up(size_t offset, size_t alignment)
+{
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+PoolResource::PoolResource(size_t capacity, std::pmr::memory_resource* upstream):
+  _base(nullptr),
+  _capacity(0),
+  _offset(0),
+  _upstream(upstream),
+  _overflow(nullptr),
+  _overflow_bytes(0)
+{
+  Rebind(capacity);
+}
+
+PoolResource::~PoolResource()
+{
+  Release();
+}
+
+void PoolResource::Rebind(size_t capacity)
+{
+  // Quietly: this runs in NextFrame(), and PoolView otherwise prints
+  // whenever it lets go of a pool.
+  _view.reset();
+  _view.emplace(get_pool(capacity));
+  _view->name = "PoolResource";
+  _view->quiet = true;
+
+  // get_pool() hands back an empty vector with at least `capacity`
+  // reserved; size it so the whole reservation is addressable.
+  std::vector<char>& storage = _view->vector();
+  storage.resize(storage.capacity());
+  _base = storage.data();
+  _capacity = storage.size();
+  _offset = 0;
+}
+
+void PoolResource::Release()
+{
+  while (_overflow != nullptr)
+  {
+    OverflowBlock* block = _overflow;
+    _overflow = block->next;
+    _upstream->deallocate(block, block->size, block->alignment);
+  }
+  _overflow_bytes = 0;
+  _offset = 0;
+}
+
+void* PoolResource::do_allocate(size_t bytes, size_t alignment)
+{
+  // Align the actual address, not just the offset -- the pool's
+  // storage is only guaranteed to be aligned for max_align_t.
+  uintptr_t base = (uintptr_t)_base;
+  size_t start = align_up(base + _offset, alignment) - base;
+  if (start + bytes <= _capacity)
+  {
+    _offset = start + bytes;
+    return _base + start;
+  }
+
+  // Out of pool space. Prefix the upstream block with a header so
+  // Release() can find it again.
+  size_t header = align_up(sizeof(OverflowBlock), alignment);
+  size_t block_alignment = alignment > alignof(OverflowBlock) ? alignment : alignof(OverflowBlock);
+  char* raw = (char*)_upstream->allocate(header + bytes, block_alignment);
+  OverflowBlock* block = (OverflowBlock*)raw;
+  block->next = _overflow;
+  block->size = header + bytes;
+  block->alignment = block_alignment;
+  _overflow = block;
+  _overflow_bytes += bytes;
+  return raw + header;
+}
+
+FrameArena::FrameArena(size_t initial_capacity):
+  PoolResource(initial_capacity, std::pmr::new_delete_resource()),
+  _high_water_mark(0)
+{
+}
+
+void FrameArena::NextFrame()
+{
+  size_t frame_bytes = BytesUsed() + BytesOverflowed();
+  if (frame_bytes > _high_water_mark)
+    _high_water_mark = frame_bytes;
+
+  bool overflowed = BytesOverflowed() > 0;
+  Release();
+
+  if (overflowed)
+  {
+    Rebind(_high_water_mark);
+  }
+}
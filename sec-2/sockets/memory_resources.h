@@ -0,0 +1,73 @@
+#pragma once
+
+#include <memory_resource>
+#include <optional>
+#include "pool.h"
+
+// A std::pmr::memory_resource that bump-allocates out of one of the
+// pools from pool.cpp. The pool stays locked for as long as the
+// resource lives. Individual deallocations are no-ops; everything is
+// handed back at once by Release() or the destructor.
+//
+// Requests that don't fit in the pool go to `upstream` (by default
+// they throw std::bad_alloc, so a too-small pool is loud rather than
+// silently hitting the heap).
+class PoolResource : public std::pmr::memory_resource
+{
+ public:
+  PoolResource(size_t capacity,
+               std::pmr::memory_resource* upstream = std::pmr::null_memory_resource());
+  ~PoolResource();
+
+  PoolResource(const PoolResource& other) = delete;
+  PoolResource& operator=(const PoolResource& other) = delete;
+
+  void Release();
+
+  size_t Capacity() const { return _capacity; }
+  size_t BytesUsed() const { return _offset; }
+  size_t BytesOverflowed() const { return _overflow_bytes; }
+
+ protected:
+  void* do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void*, size_t, size_t) override {}
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+  {
+    return this == &other;
+  }
+
+  void Rebind(size_t capacity);
+
+  struct OverflowBlock
+  {
+    OverflowBlock* next;
+    size_t size;
+    size_t alignment;
+  };
+
+  std::optional<PoolView> _view;
+  char* _base;
+  size_t _capacity;
+  size_t _offset;
+
+  std::pmr::memory_resource* _upstream;
+  OverflowBlock* _overflow;
+  size_t _overflow_bytes;
+};
+
+// Per-frame monotonic arena. Allocate freely during a frame, then call
+// NextFrame() to throw it all away. If a frame overflowed the pool
+// into the heap, the arena moves to a pool big enough for that frame,
+// so steady-state frames never touch the global heap.
+class FrameArena : public PoolResource
+{
+ public:
+  FrameArena(size_t initial_capacity = 64 * 1024);
+
+  void NextFrame();
+
+  size_t HighWaterMark() const { return _high_water_mark; }
+
+ private:
+  size_t _high_water_mark;
+};
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "bytestream.h"
+#include "wire_endian.h"
+
+// Compile-time field descriptors
+// ==============================
+// Declare a type's networked fields once:
+//
+//     template<> struct NetFields<GameObject> {
+//       static constexpr auto fields = std::make_tuple(
+//         NET_FIELD(GameObject, x),
+//         NET_FIELD(GameObject, y));
+//     };
+//
+// and the functions below generate everything else: the wire size,
+// encode/decode to a raw buffer or a byte stream, and per-field diffs.
+// The field loops are expanded at compile time, so each generated
+// function is a straight line of fixed-offset copies behind a single
+// bounds check. Types whose fields exactly tile a trivially copyable
+// struct (in declaration order) collapse into one memcpy on
+// little-endian hosts, where memory order is already wire order.
+//
+// Fields are written in the order listed, which is the wire format.
+// Only append new fields at the end.
+
+template<typename T>
+struct NetFields;
+
+template<typename Class, typename Member>
+struct NetField
+{
+  typedef Member type;
+
+  Member Class::* member;
+  const char* name;
+};
+
+template<typename Class, typename Member>
+constexpr NetField<Class, Member> net_field(Member Class::* member, const char* name)
+{
+  return NetField<Class, Member>{ member, name };
+}
+
+#define NET_FIELD(Type, member) net_field(&Type::member, #member)
+
+template<typename T>
+constexpr size_t net_field_count()
+{
+  return std::tuple_size<decltype(NetFields<T>::fields)>::value;
+}
+
+// Calls fn(index, field_descriptor) for every field, unrolled.
+template<typename T, typename Fn, size_t... I>
+inline void net_for_each_field_impl(Fn&& fn, std::index_sequence<I...>)
+{
+  (fn(std::integral_constant<size_t, I>(), std::get<I>(NetFields<T>::fields)), ...);
+}
+
+template<typename T, typename Fn>
+inline void net_for_each_field(Fn&& fn)
+{
+  net_for_each_field_impl<T>(fn, std::make_index_sequence<net_field_count<T>()>());
+}
+
+template<typename T, size_t... I>
+constexpr size_t net_size_impl(std::index_sequence<I...>)
+{
+  return (0 + ... + sizeof(typename std::tuple_element<I, decltype(NetFields<T>::fields)>::type::type));
+}
+
+// Bytes one T takes on the wire.
+template<typename T>
+constexpr size_t net_size()
+{
+  return net_size_impl<T>(std::make_index_sequence<net_field_count<T>()>());
+}
+
+// True when the wire format is byte-for-byte the in-memory layout.
+template<typename T>
+constexpr bool net_is_memcpyable()
+{
+  return !kHostIsBigEndian
+      && std::is_trivially_copyable<T>::value
+      && std::is_standard_layout<T>::value
+      && net_size<T>() == sizeof(T);
+}
+
+// The memcpy path relies on the fields being listed in declaration
+// order; check that once per type in debug builds. The result is
+// kept in a static, so later asserts don't build another probe.
+template<typename T>
+inline bool net_layout_matches_declaration()
+{
+  static const bool matches = [] {
+    T probe{};
+    size_t expected_offset = 0;
+    bool in_order = true;
+    net_for_each_field<T>([&](auto, const auto& field) {
+      size_t offset = (size_t)((const char*)&(probe.*field.member) - (const char*)&probe);
+      in_order = in_order && offset == expected_offset;
+      expected_offset += sizeof(probe.*field.member);
+    });
+    return in_order;
+  }();
+  return matches;
+}
+
+// Writes exactly net_size<T>() bytes to out, no bounds checks.
+template<typename T>
+inline void net_encode_unchecked(const T& value, char* out)
+{
+  if constexpr (net_is_memcpyable<T>())
+  {
+    assert(net_layout_matches_declaration<T>());
+    memcpy(out, &value, sizeof(T));
+  }
+  else
+  {
+    size_t offset = 0;
+    net_for_each_field<T>([&](auto, const auto& field) {
+      store_le(out + offset, value.*field.member);
+      offset += sizeof(value.*field.member);
+    });
+  }
+}
+
+template<typename T>
+inline void net_decode_unchecked(T& value, const char* in)
+{
+  if constexpr (net_is_memcpyable<T>())
+  {
+    assert(net_layout_matches_declaration<T>());
+    memcpy(&value, in, sizeof(T));
+  }
+  else
+  {
+    size_t offset = 0;
+    net_for_each_field<T>([&](auto, const auto& field) {
+      value.*field.member = load_le<typename std::decay_t<decltype(field)>::type>(in + offset);
+      offset += sizeof(value.*field.member);
+    });
+  }
+}
+
+// Returns bytes written, or 0 if the buffer is too small.
+template<typename T>
+inline size_t net_encode(const T& value, char* buffer, size_t buffer_size)
+{
+  if (buffer_size < net_size<T>()) return 0;
+  net_encode_unchecked(value, buffer);
+  return net_size<T>();
+}
+
+// Returns bytes read, or 0 if the buffer is too short.
+template<typename T>
+inline size_t net_decode(T& value, const char* buffer, size_t buffer_size)
+{
+  if (buffer_size < net_size<T>()) return 0;
+  net_decode_unchecked(value, buffer);
+  return net_size<T>();
+}
+
+template<typename T>
+inline bool net_write(OutByteStream& stream, const T& value)
+{
+  char* out = stream.Reserve(net_size<T>());
+  if (out == nullptr) return false;
+  net_encode_unchecked(value, out);
+  return true;
+}
+
+template<typename T>
+inline bool net_read(InByteStream& stream, T& value)
+{
+  ByteSpan in = stream.ReadSpan(net_size<T>());
+  if (in.data == nullptr) return false;
+  net_decode_unchecked(value, in.data);
+  return true;
+}
+
+// Bit i is set when field i differs between a and b.
+template<typename T>
+inline uint32_t net_diff(const T& a, const T& b)
+{
+  static_assert(net_field_count<T>() <= 32, "net_diff() masks hold at most 32 fields");
+  uint32_t mask = 0;
+  net_for_each_field<T>([&](auto index, const auto& field) {
+    if (memcmp(&(a.*field.member), &(b.*field.member), sizeof(a.*field.member)) != 0)
+      mask |= 1u << index;
+  });
+  return mask;
+}
+
+// Writes only the fields whose bit is set in mask.
+template<typename T>
+inline bool net_write_fields(OutByteStream& stream, const T& value, uint32_t mask)
+{
+  net_for_each_field<T>([&](auto index, const auto& field) {
+    if (mask & (1u << index))
+      stream.Insert(value.*field.member);
+  });
+  return stream.ok();
+}
+
+template<typename T>
+inline bool net_read_fields(InByteStream& stream, T& value, uint32_t mask)
+{
+  net_for_each_field<T>([&](auto index, const auto& field) {
+    if (mask & (1u << index))
+      stream.Read(value.*field.member);
+  });
+  return stream.ok();
+}
+
+// Compact encoding: integer fields as varints (zigzag for signed ones),
+// everything else fixed-width. Smaller for typical game state, where
+// most velocities and many coordinates are small, at the cost of a
+// variable size. Only the fields set in mask are written.
+template<typename T>
+inline bool net_write_compact(OutByteStream& stream, const T& value, uint32_t mask = ~0u)
+{
+  net_for_each_field<T>([&](auto index, const auto& field) {
+    typedef typename std::decay_t<decltype(field)>::type Field;
+    if (!(mask & (1u << index))) return;
+    if constexpr (std::is_integral<Field>::value && std::is_signed<Field>::value)
+      stream.InsertZigZag(value.*field.member);
+    else if constexpr (std::is_integral<Field>::value)
+      stream.InsertVarint(value.*field.member);
+    else
+      stream.Insert(value.*field.member);
+  });
+  return stream.ok();
+}
+
+template<typename T>
+inline bool net_read_compact(InByteStream& stream, T& value, uint32_t mask = ~0u)
+{
+  net_for_each_field<T>([&](auto index, const auto& field) {
+    typedef typename std::decay_t<decltype(field)>::type Field;
+    if (!(mask & (1u << index))) return;
+    if constexpr (std::is_integral<Field>::value && std::is_signed<Field>::value)
+      stream.ReadZigZag(value.*field.member);
+    else if constexpr (std::is_integral<Field>::value)
+      stream.ReadVarint(value.*field.member);
+    else
+      stream.Read(value.*field.member);
+  });
+  return stream.ok();
+}
@@ -0,0 +1,304 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include "bytestream.h"
+#include "net_fields.h"
+
+// Network object registry
+// =======================
+// Both ends need to agree on which object a message is about. The
+// server hands out a network id per replicated object, and the client
+// keeps the same id -> object mapping, so an update names its object
+// directly instead of the client rebuilding its whole list.
+//
+// Ids are dense: the low kNetIdIndexBits bits are a slot index,
+// recycled through a free list, so lookup is a direct index into the
+// slot table -- no hashing. The high bits are a
+// generation that changes every time a slot is reused, so a late
+// message about a destroyed object can't land on its replacement.
+//
+// Destroyed objects stay allocated in their slot and are reset and
+// reused by the next create, so a steady-state game doesn't allocate.
+// Slots live in fixed-size pages that never move, so T* stays valid as
+// the table grows, and finding a slot is a shift and a mask.
+//
+// The server side marks what changed (Create(), MarkDirty(),
+// Destroy()); write_registry_batch() sends the pending creates,
+// masked updates and destroys as one message, and
+// apply_registry_batch() applies it in place on the client, through
+// CreateAt()/Get()/DestroyAt(). A client's max_objects bounds how far
+// a (possibly hostile) server can grow its table.
+
+const int kNetIdIndexBits = 20;
+const uint32_t kNetIdIndexMask = (1u << kNetIdIndexBits) - 1;
+const uint32_t kNetIdGenerationMask = (1u << (32 - kNetIdIndexBits)) - 1;
+const uint32_t kInvalidNetId = 0xffffffff;
+
+inline uint32_t net_id_index(uint32_t id) { return id & kNetIdIndexMask; }
+inline uint32_t net_id_generation(uint32_t id) { return id >> kNetIdIndexBits; }
+
+template<typename T>
+class NetRegistry
+{
+ public:
+  // The last index is left out so that no id equals kInvalidNetId.
+  explicit NetRegistry(size_t max_objects = kNetIdIndexMask):
+    _max_objects(max_objects < kNetIdIndexMask ? max_objects : kNetIdIndexMask),
+    _count(0)
+  {
+  }
+
+  NetRegistry(const NetRegistry& other) = delete;
+  NetRegistry& operator=(const NetRegistry& other) = delete;
+
+  // Server side: allocates an id and a (default-initialized) object.
+  // Returns kInvalidNetId when the registry is full.
+  uint32_t Create()
+  {
+    uint32_t index;
+    if (!_free.empty())
+    {
+      index = _free.back();
+      _free.pop_back();
+    }
+    else
+    {
+      if (_num_slots >= _max_objects) return kInvalidNetId;
+      index = (uint32_t)_num_slots;
+      Grow(index);
+    }
+    Slot& slot = At(index);
+    uint32_t id = index | (((slot.generation + 1) & kNetIdGenerationMask) << kNetIdIndexBits);
+    Revive(slot, id);
+    slot.pending_create = true;
+    _created.push_back(id);
+    return id;
+  }
+
+  // Client side: mirrors an id the server created, reusing whatever
+  // was in that slot. Null if the index is beyond max_objects.
+  T* CreateAt(uint32_t id)
+  {
+    uint32_t index = net_id_index(id);
+    if (index >= _max_objects) return nullptr;
+    Grow(index);
+    Slot& slot = At(index);
+    if (slot.alive) _count--;
+    Revive(slot, id);
+    return &slot.object;
+  }
+
+  // O(1). Null for unknown, destroyed or stale ids.
+  T* Get(uint32_t id)
+  {
+    Slot* slot = Find(id);
+    return slot ? &slot->object : nullptr;
+  }
+
+  const T* Get(uint32_t id) const { return const_cast<NetRegistry*>(this)->Get(id); }
+
+  // Records that the fields in mask (see net_diff()) changed.
+  void MarkDirty(uint32_t id, uint32_t mask = ~0u)
+  {
+    Slot* slot = Find(id);
+    if (slot == nullptr || mask == 0) return;
+    if (slot->dirty_mask == 0) _dirty.push_back(id);
+    slot->dirty_mask |= mask;
+  }
+
+  // Server side. Returns false for unknown or stale ids.
+  bool Destroy(uint32_t id)
+  {
+    if (!DestroyAt(id)) return false;
+    _free.push_back(net_id_index(id));
+    _destroyed.push_back(id);
+    return true;
+  }
+
+  // Client side: mirrors a destroy. The object stays in its slot for
+  // the next CreateAt() there.
+  bool DestroyAt(uint32_t id)
+  {
+    Slot* slot = Find(id);
+    if (slot == nullptr) return false;
+    slot->alive = false;
+    slot->dirty_mask = 0;
+    slot->pending_create = false;
+    _count--;
+    return true;
+  }
+
+  size_t Count() const { return _count; }
+
+  // fn(id, object) for every live object, in index order.
+  template<typename Fn>
+  void ForEach(Fn&& fn)
+  {
+    for (size_t i = 0; i < _num_slots; i++)
+    {
+      Slot& slot = At(i);
+      if (slot.alive) fn(slot.id, slot.object);
+    }
+  }
+
+ private:
+  template<typename U>
+  friend bool write_registry_batch(OutByteStream& stream, NetRegistry<U>& registry);
+
+  struct Slot
+  {
+    T object{};
+    uint32_t id = kInvalidNetId;
+    uint32_t generation = 0;
+    uint32_t dirty_mask = 0;
+    bool alive = false;
+    bool pending_create = false;
+  };
+
+  static const int kPageBits = 8;
+  static const size_t kPageSize = (size_t)1 << kPageBits;
+
+  Slot& At(size_t index) { return _pages[index >> kPageBits][index & (kPageSize - 1)]; }
+
+  // Makes sure slots up to and including index exist.
+  void Grow(size_t index)
+  {
+    while (_pages.size() <= (index >> kPageBits))
+      _pages.emplace_back(new Slot[kPageSize]);
+    if (index >= _num_slots) _num_slots = index + 1;
+  }
+
+  Slot* Find(uint32_t id)
+  {
+    uint32_t index = net_id_index(id);
+    if (index >= _num_slots) return nullptr;
+    Slot& slot = At(index);
+    return slot.alive && slot.id == id ? &slot : nullptr;
+  }
+
+  void Revive(Slot& slot, uint32_t id)
+  {
+    slot.object = T();
+    slot.id = id;
+    slot.generation = net_id_generation(id);
+    slot.dirty_mask = 0;
+    slot.pending_create = false;
+    slot.alive = true;
+    _count++;
+  }
+
+  std::vector<std::unique_ptr<Slot[]>> _pages;
+  size_t _num_slots = 0;
+  std::vector<uint32_t> _free;
+  size_t _max_objects;
+  size_t _count;
+
+  // Pending changes for the next write_registry_batch().
+  std::vector<uint32_t> _created;
+  std::vector<uint32_t> _dirty;
+  std::vector<uint32_t> _destroyed;
+};
+
+// Wire format:
+//
+//     varint  number of creates
+//       varint  id, then every field (net_write_compact())
+//     varint  number of updates
+//       varint  id, varint field mask, then the masked fields
+//     varint  number of destroys
+//       varint  id
+//
+// Writes and clears everything pending in registry.
+template<typename T>
+bool write_registry_batch(OutByteStream& stream, NetRegistry<T>& registry)
+{
+  typedef typename NetRegistry<T>::Slot Slot;
+
+  // Creates that were destroyed again before being sent are dropped;
+  // the client ignores the destroy for an id it never saw.
+  size_t creates = 0;
+  for (uint32_t id : registry._created)
+  {
+    Slot* slot = registry.Find(id);
+    if (slot && slot->pending_create) creates++;
+  }
+  stream.InsertVarint(creates);
+  for (uint32_t id : registry._created)
+  {
+    Slot* slot = registry.Find(id);
+    if (slot == nullptr || !slot->pending_create) continue;
+    stream.InsertVarint(id);
+    net_write_compact(stream, slot->object);
+  }
+
+  // New objects already went out in full.
+  size_t updates = 0;
+  for (uint32_t id : registry._dirty)
+  {
+    Slot* slot = registry.Find(id);
+    if (slot && !slot->pending_create && slot->dirty_mask != 0) updates++;
+  }
+  stream.InsertVarint(updates);
+  for (uint32_t id : registry._dirty)
+  {
+    Slot* slot = registry.Find(id);
+    if (slot == nullptr || slot->pending_create || slot->dirty_mask == 0) continue;
+    stream.InsertVarint(id);
+    stream.InsertVarint(slot->dirty_mask);
+    net_write_compact(stream, slot->object, slot->dirty_mask);
+  }
+
+  stream.InsertVarint(registry._destroyed.size());
+  for (uint32_t id : registry._destroyed)
+    stream.InsertVarint(id);
+
+  for (uint32_t id : registry._created)
+    if (Slot* slot = registry.Find(id)) slot->pending_create = false;
+  for (uint32_t id : registry._dirty)
+    if (Slot* slot = registry.Find(id)) slot->dirty_mask = 0;
+  registry._created.clear();
+  registry._dirty.clear();
+  registry._destroyed.clear();
+  return stream.ok();
+}
+
+// Applies a batch in place: creates reuse slots, updates write the
+// masked fields straight into the existing objects, destroys free
+// their slots. Updates for unknown ids are read and dropped.
+template<typename T>
+bool apply_registry_batch(InByteStream& stream, NetRegistry<T>& registry)
+{
+  uint32_t count = 0;
+  uint32_t id = 0;
+
+  stream.ReadVarint(count);
+  for (uint32_t i = 0; i < count && stream.ok(); i++)
+  {
+    stream.ReadVarint(id);
+    T* object = registry.CreateAt(id);
+    if (object == nullptr) return false;
+    net_read_compact(stream, *object);
+  }
+
+  T discard{};
+  stream.ReadVarint(count);
+  for (uint32_t i = 0; i < count && stream.ok(); i++)
+  {
+    uint32_t mask = 0;
+    stream.ReadVarint(id);
+    stream.ReadVarint(mask);
+    T* object = registry.Get(id);
+    net_read_compact(stream, object ? *object : discard, mask);
+  }
+
+  stream.ReadVarint(count);
+  for (uint32_t i = 0; i < count && stream.ok(); i++)
+  {
+    stream.ReadVarint(id);
+    registry.DestroyAt(id);
+  }
+  return stream.ok();
+}
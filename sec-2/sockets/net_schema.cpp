@@ -0,0 +1,122 @@
+#include "net_schema.h"
+#include <string.h>
+
+bool net_type_code_valid(uint8_t type_code)
+{
+  size_t size = net_type_size(type_code);
+  switch (net_type_kind(type_code))
+  {
+  case NET_KIND_INT:
+  case NET_KIND_UINT:
+    return size == 1 || size == 2 || size == 4 || size == 8;
+  case NET_KIND_FLOAT:
+    return size == 4 || size == 8;
+  default:
+    return false;
+  }
+}
+
+// FNV-1a over each field's type code and name.
+uint64_t net_schema_hash(const std::vector<NetSchemaField>& fields)
+{
+  uint64_t hash = 0xcbf29ce484222325ull;
+  auto mix = [&](uint8_t byte) {
+    hash ^= byte;
+    hash *= 0x100000001b3ull;
+  };
+  for (const NetSchemaField& field : fields)
+  {
+    mix(field.type_code);
+    for (char c : field.name) mix((uint8_t)c);
+    mix(0);
+  }
+  return hash;
+}
+
+bool write_schema(OutByteStream& stream, const NetSchema& schema)
+{
+  stream.Insert(schema.hash);
+  stream.InsertVarint(schema.fields.size());
+  for (const NetSchemaField& field : schema.fields)
+  {
+    stream.Insert(field.type_code);
+    stream.InsertString(field.name.data(), field.name.size());
+  }
+  return stream.ok();
+}
+
+bool read_schema(InByteStream& stream, NetSchema& schema, size_t max_fields)
+{
+  uint64_t count = 0;
+  stream.Read(schema.hash);
+  stream.ReadVarint(count);
+  if (!stream.ok() || count > max_fields) return false;
+
+  schema.fields.clear();
+  for (uint64_t i = 0; i < count; i++)
+  {
+    NetSchemaField field;
+    stream.Read(field.type_code);
+    ByteSpan name = stream.ReadString();
+    if (!stream.ok() || !net_type_code_valid(field.type_code)) return false;
+    field.name.assign(name.data, name.size);
+    schema.fields.push_back(field);
+  }
+  return net_schema_hash(schema.fields) == schema.hash;
+}
+
+template<typename Int>
+static bool read_int(InByteStream& stream, bool compact, NetValue& value)
+{
+  Int x;
+  bool ok;
+  if (!compact)
+    ok = stream.Read(x);
+  else if constexpr (std::is_signed<Int>::value)
+    ok = stream.ReadZigZag(x);
+  else
+    ok = stream.ReadVarint(x);
+  if (std::is_signed<Int>::value)
+  {
+    value.kind = NET_KIND_INT;
+    value.i = (int64_t)x;
+  }
+  else
+  {
+    value.kind = NET_KIND_UINT;
+    value.u = (uint64_t)x;
+  }
+  return ok;
+}
+
+bool read_net_value(InByteStream& stream, uint8_t type_code, bool compact, NetValue& value)
+{
+  value.i = 0;
+  value.u = 0;
+  value.f = 0;
+  switch (type_code)
+  {
+  case (NET_KIND_INT << 4) | 1: return read_int<int8_t>(stream, compact, value);
+  case (NET_KIND_INT << 4) | 2: return read_int<int16_t>(stream, compact, value);
+  case (NET_KIND_INT << 4) | 4: return read_int<int32_t>(stream, compact, value);
+  case (NET_KIND_INT << 4) | 8: return read_int<int64_t>(stream, compact, value);
+  case (NET_KIND_UINT << 4) | 1: return read_int<uint8_t>(stream, compact, value);
+  case (NET_KIND_UINT << 4) | 2: return read_int<uint16_t>(stream, compact, value);
+  case (NET_KIND_UINT << 4) | 4: return read_int<uint32_t>(stream, compact, value);
+  case (NET_KIND_UINT << 4) | 8: return read_int<uint64_t>(stream, compact, value);
+  case (NET_KIND_FLOAT << 4) | 4:
+  {
+    // Floats are fixed-width in both forms.
+    float f;
+    value.kind = NET_KIND_FLOAT;
+    bool ok = stream.Read(f);
+    value.f = f;
+    return ok;
+  }
+  case (NET_KIND_FLOAT << 4) | 8:
+    value.kind = NET_KIND_FLOAT;
+    return stream.Read(value.f);
+  default:
+    return false;
+  }
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "bytestream.h"
+#include "net_fields.h"
+
+// Versioned wire schemas
+// ======================
+// net_fields.h encodes fields by position, with no tags, so both ends
+// must agree on the field list exactly. To let the two ends differ
+// (a rolling upgrade, or sec-1 talking to sec-2), each side sends its
+// schema once when it connects:
+//
+//     uint64  schema hash
+//     varint  field count
+//       uint8   type code (kind << 4 | size in bytes)
+//       uint32  name length, then the name
+//
+// The receiver keeps a NetSchemaDecoder per connection. If the hashes
+// match, Read() is just net_read() -- the generated straight-line
+// decoder, with nothing added per packet but one predictable branch.
+// Otherwise the decoder maps the sender's fields to ours by name,
+// converts between integer and float types, skips fields we don't
+// have, and leaves fields the sender doesn't have at their defaults.
+//
+// The hash covers field names, types and order, so renaming or
+// reordering a field counts as a schema change.
+
+enum NetFieldKind
+{
+  NET_KIND_INT = 1,
+  NET_KIND_UINT = 2,
+  NET_KIND_FLOAT = 3
+};
+
+inline uint8_t net_type_code(NetFieldKind kind, size_t size) { return (uint8_t)((kind << 4) | size); }
+inline NetFieldKind net_type_kind(uint8_t type_code) { return (NetFieldKind)(type_code >> 4); }
+inline size_t net_type_size(uint8_t type_code) { return type_code & 0xf; }
+bool net_type_code_valid(uint8_t type_code);
+
+template<typename Field>
+inline uint8_t net_type_code_of()
+{
+  if constexpr (std::is_enum<Field>::value)
+    return net_type_code_of<typename std::underlying_type<Field>::type>();
+  else if constexpr (std::is_same<Field, bool>::value)
+    return net_type_code(NET_KIND_UINT, 1);
+  else if constexpr (std::is_floating_point<Field>::value)
+    return net_type_code(NET_KIND_FLOAT, sizeof(Field));
+  else if constexpr (std::is_signed<Field>::value)
+    return net_type_code(NET_KIND_INT, sizeof(Field));
+  else
+    return net_type_code(NET_KIND_UINT, sizeof(Field));
+}
+
+struct NetSchemaField
+{
+  std::string name;
+  uint8_t type_code;
+};
+
+struct NetSchema
+{
+  uint64_t hash = 0;
+  std::vector<NetSchemaField> fields;
+};
+
+uint64_t net_schema_hash(const std::vector<NetSchemaField>& fields);
+bool write_schema(OutByteStream& stream, const NetSchema& schema);
+// Rejects unknown type codes, more than max_fields fields, and a hash
+// that doesn't match the fields.
+bool read_schema(InByteStream& stream, NetSchema& schema, size_t max_fields = 32);
+
+// T's own schema, built from NetFields<T> on first use.
+template<typename T>
+const NetSchema& net_schema()
+{
+  static const NetSchema schema = [] {
+    NetSchema s;
+    net_for_each_field<T>([&](auto, const auto& field) {
+      typedef typename std::decay_t<decltype(field)>::type Field;
+      s.fields.push_back(NetSchemaField{ field.name, net_type_code_of<Field>() });
+    });
+    s.hash = net_schema_hash(s.fields);
+    return s;
+  }();
+  return schema;
+}
+
+// One field value in whatever type the sender used.
+struct NetValue
+{
+  NetFieldKind kind;
+  int64_t i;
+  uint64_t u;
+  double f;
+};
+
+// Reads one value of the given type, fixed-width or (compact) in the
+// varint/zigzag form of net_write_compact().
+bool read_net_value(InByteStream& stream, uint8_t type_code, bool compact, NetValue& value);
+
+// Converts to a local field type. Out-of-range floats saturate rather
+// than invoking undefined behaviour.
+template<typename Field>
+inline Field net_value_as(const NetValue& value)
+{
+  if constexpr (std::is_enum<Field>::value)
+  {
+    return (Field)net_value_as<typename std::underlying_type<Field>::type>(value);
+  }
+  else if constexpr (std::is_floating_point<Field>::value)
+  {
+    switch (value.kind)
+    {
+    case NET_KIND_INT: return (Field)value.i;
+    case NET_KIND_UINT: return (Field)value.u;
+    default: return (Field)value.f;
+    }
+  }
+  else
+  {
+    switch (value.kind)
+    {
+    case NET_KIND_INT: return (Field)value.i;
+    case NET_KIND_UINT: return (Field)value.u;
+    default:
+    {
+      double lo = (double)std::numeric_limits<Field>::min();
+      double hi = (double)std::numeric_limits<Field>::max();
+      double f = value.f;
+      if (!(f >= lo)) return std::numeric_limits<Field>::min();
+      if (f >= hi) return std::numeric_limits<Field>::max();
+      return (Field)f;
+    }
+    }
+  }
+}
+
+template<typename T>
+class NetSchemaDecoder
+{
+ public:
+  // Until SetRemote() is called, the sender is assumed to match.
+  NetSchemaDecoder(): _same(true) {}
+
+  void SetRemote(const NetSchema& remote)
+  {
+    _same = remote.hash == net_schema<T>().hash;
+    _fields.clear();
+    if (_same) return;
+
+    const NetSchema& local = net_schema<T>();
+    for (const NetSchemaField& field : remote.fields)
+    {
+      int local_index = -1;
+      for (size_t i = 0; i < local.fields.size(); i++)
+      {
+        if (local.fields[i].name == field.name)
+        {
+          local_index = (int)i;
+          break;
+        }
+      }
+      _fields.push_back(Mapping{ field.type_code, local_index });
+    }
+  }
+
+  bool SameSchema() const { return _same; }
+
+  // Counterpart to net_write().
+  bool Read(InByteStream& stream, T& value) const
+  {
+    if (_same) return net_read(stream, value);
+    return ReadMapped(stream, value, false, ~0u);
+  }
+
+  // Counterpart to net_write_compact(). mask is over the sender's
+  // fields, as written.
+  bool ReadCompact(InByteStream& stream, T& value, uint32_t mask = ~0u) const
+  {
+    if (_same) return net_read_compact(stream, value, mask);
+    return ReadMapped(stream, value, true, mask);
+  }
+
+ private:
+  struct Mapping
+  {
+    uint8_t type_code;
+    // -1 when we don't have the field.
+    int local_index;
+  };
+
+  typedef void (*Setter)(T&, const NetValue&);
+
+  template<size_t I>
+  static void SetField(T& object, const NetValue& value)
+  {
+    const auto& field = std::get<I>(NetFields<T>::fields);
+    typedef typename std::decay_t<decltype(field)>::type Field;
+    object.*field.member = net_value_as<Field>(value);
+  }
+
+  template<size_t... I>
+  static const Setter* Setters(std::index_sequence<I...>)
+  {
+    static const Setter setters[] = { &SetField<I>... };
+    return setters;
+  }
+
+  bool ReadMapped(InByteStream& stream, T& value, bool compact, uint32_t mask) const
+  {
+    const Setter* setters = Setters(std::make_index_sequence<net_field_count<T>()>());
+    for (size_t i = 0; i < _fields.size(); i++)
+    {
+      if (i < 32 && !(mask & (1u << i))) continue;
+      NetValue field_value;
+      if (!read_net_value(stream, _fields[i].type_code, compact, field_value)) return false;
+      if (_fields[i].local_index >= 0) setters[_fields[i].local_index](value, field_value);
+    }
+    return stream.ok();
+  }
+
+  bool _same;
+  std::vector<Mapping> _fields;
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <stddef.h>
+#include <charconv>
+#include <system_error>
+#include <type_traits>
+#include "net_fields.h"
+
+// Text encoding
+// =============
+// The NetFields of an object as decimal numbers separated by spaces,
+// e.g. "120 -45 3 0 0 0" -- the same format as
+// SerializeGameObjectAsString(), which debug and interop tools read
+// and write by hand.
+//
+// Numbers are formatted straight into the caller's buffer with
+// std::to_chars and parsed back with std::from_chars: no stream, no
+// temporary string, no locale, no allocation. Floats use the shortest
+// form that reads back to the same value.
+//
+// Bulk form: many objects on one line, separated by commas and ended
+// by a newline:
+//
+//     120 -45 3 0 0 0,121 -45 3 1 0 0\n
+//
+// Parsing accepts any run of spaces or tabs between fields, and
+// leading '+' is rejected, as from_chars does.
+
+template<typename Field>
+inline char* net_format_text_field(char* first, char* last, Field value)
+{
+  if constexpr (std::is_enum<Field>::value)
+  {
+    return net_format_text_field(first, last, (typename std::underlying_type<Field>::type)value);
+  }
+  else if constexpr (std::is_same<Field, bool>::value)
+  {
+    return net_format_text_field(first, last, (int)value);
+  }
+  else
+  {
+    std::to_chars_result result = std::to_chars(first, last, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+  }
+}
+
+template<typename Field>
+inline const char* net_parse_text_field(const char* first, const char* last, Field& value)
+{
+  if constexpr (std::is_enum<Field>::value)
+  {
+    typename std::underlying_type<Field>::type underlying{};
+    const char* end = net_parse_text_field(first, last, underlying);
+    if (end) value = (Field)underlying;
+    return end;
+  }
+  else if constexpr (std::is_same<Field, bool>::value)
+  {
+    int number = 0;
+    const char* end = net_parse_text_field(first, last, number);
+    if (end == nullptr || (number != 0 && number != 1)) return nullptr;
+    value = number != 0;
+    return end;
+  }
+  else
+  {
+    std::from_chars_result result = std::from_chars(first, last, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+  }
+}
+
+inline const char* net_skip_text_blanks(const char* first, const char* last)
+{
+  while (first != last && (*first == ' ' || *first == '\t')) first++;
+  return first;
+}
+
+// Writes value's fields into [first, last). Returns the end of what was
+// written, or nullptr if it didn't fit.
+template<typename T>
+inline char* net_format_text(char* first, char* last, const T& value)
+{
+  char* pos = first;
+  net_for_each_field<T>([&](auto index, const auto& field) {
+    if (pos == nullptr) return;
+    if (index != 0)
+    {
+      if (pos == last)
+      {
+        pos = nullptr;
+        return;
+      }
+      *pos++ = ' ';
+    }
+    pos = net_format_text_field(pos, last, value.*field.member);
+  });
+  return pos;
+}
+
+// Parses value's fields from [first, last), skipping blanks before each
+// one. Returns the end of the last field, or nullptr if the text was
+// malformed or ran out. Fields already parsed are left in value.
+template<typename T>
+inline const char* net_parse_text(const char* first, const char* last, T& value)
+{
+  const char* pos = first;
+  net_for_each_field<T>([&](auto, const auto& field) {
+    if (pos == nullptr) return;
+    pos = net_parse_text_field(net_skip_text_blanks(pos, last), last, value.*field.member);
+  });
+  return pos;
+}
+
+// Bulk form: count objects as one line. Returns the bytes written,
+// newline included, or 0 if they didn't fit.
+template<typename T>
+inline size_t net_format_text_line(char* buffer, size_t buffer_size, const T* objects, size_t count)
+{
+  char* pos = buffer;
+  char* last = buffer + buffer_size;
+  for (size_t i = 0; i < count; i++)
+  {
+    if (i != 0)
+    {
+      if (pos == last) return 0;
+      *pos++ = ',';
+    }
+    pos = net_format_text(pos, last, objects[i]);
+    if (pos == nullptr) return 0;
+  }
+  if (pos == last) return 0;
+  *pos++ = '\n';
+  return pos - buffer;
+}
+
+// Parses one line of up to max_count objects into objects[], and sets
+// count to how many there were. Returns the bytes consumed, newline
+// included, or 0 if the line was malformed, unterminated, or held more
+// than max_count objects.
+template<typename T>
+inline size_t net_parse_text_line(const char* buffer, size_t buffer_size, T* objects, size_t max_count, size_t& count)
+{
+  const char* pos = buffer;
+  const char* last = buffer + buffer_size;
+  count = 0;
+
+  pos = net_skip_text_blanks(pos, last);
+  if (pos != last && *pos == '\n') return pos + 1 - buffer;
+
+  while (true)
+  {
+    if (count == max_count) return 0;
+    pos = net_parse_text(pos, last, objects[count]);
+    if (pos == nullptr) return 0;
+    count++;
+
+    pos = net_skip_text_blanks(pos, last);
+    if (pos == last) return 0;
+    if (*pos == '\n') return pos + 1 - buffer;
+    if (*pos != ',') return 0;
+    pos++;
+  }
+}
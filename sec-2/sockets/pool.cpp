@@ -1,8 +1,11 @@
 #include "pool.h"
+#include <list>
 #include <math.h>
 #include <stdio.h>
 
-static std::vector<Pool> pools;
+// A list, so that growing it never moves the pools that outstanding
+// PoolViews refer to.
+static std::list<Pool> pools;
 
 void add_pool_of_size(size_t size)
 {
@@ -15,7 +18,6 @@ void add_pool_of_size(size_t size)
 
 void init_pools(std::vector<size_t> sizes)
 {
-    pools.reserve(sizes.size());
     for (size_t size : sizes)
     {
 	add_pool_of_size(size);
@@ -39,5 +41,5 @@ PoolView get_pool(size_t min_size)
     int target_size = 1 << (int)ceil(fp2);
     printf("Pools exhausted! Creating pool of size %d to meet request of size %zu.\n", target_size, min_size);
     add_pool_of_size(target_size);
-    return PoolView(pools[pools.size() - 1]);
+    return PoolView(pools.back());
 }
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <vector>
 #include <stdlib.h>
 #include <stdio.h>
@@ -13,18 +15,37 @@ class PoolView
 public:
  PoolView(Pool& pool, const char* name=""):
   pool(pool),
-    name(name)
+    name(name),
+    quiet(false),
+    moved_from(false)
     {
 	pool.lock++;
     }
 
  PoolView(const PoolView& other):PoolView(other.pool, other.name) {}
 
- PoolView(PoolView&& other):PoolView(other.pool, other.name) {}
+ // Takes over other's hold on the pool, so other lets go of it
+ // without unlocking it or saying so.
+ PoolView(PoolView&& other):
+  pool(other.pool),
+    name(other.name),
+    quiet(other.quiet),
+    moved_from(false)
+    {
+	other.moved_from = true;
+    }
 
   ~PoolView()
     {
+	if (moved_from)
+	  {
+	    return;
+	  }
 	pool.lock--;
+	if (quiet)
+	  {
+	    return;
+	  }
 	if (*name != '\0')
 	  {
 	    printf("Relinquishing pool %s\n", name);
@@ -47,6 +68,9 @@ public:
 
     Pool& pool;
     const char* name;
+    // Set to skip the message when the view lets go of the pool.
+    bool quiet;
+    bool moved_from;
     std::vector<char>& vector() {return pool.pool;}
 };
 
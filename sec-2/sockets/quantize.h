@@ -0,0 +1,315 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+#include <float.h>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "bitstream.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define QUANTIZE_HAVE_SSE2 1
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Fixed-point quantization
+// ========================
+// Most fields don't need 32 bits. A position that stays within
+// [-4096, 4096] and only matters to a tenth of a unit needs 81921
+// distinct values -- 17 bits. Declare that once per field:
+//
+//     Quantization{ -4096.0f, 4096.0f, 0.1f }
+//
+// and a value is sent as round((value - min) / precision) in Bits()
+// bits. Decoding gives back min + q * precision, which is within
+// MaxError() (half the precision, give or take float rounding) of the
+// original for anything in range. Values outside [min, max] are
+// clamped, so choose ranges with some headroom.
+//
+// Integer fields quantize with integer maths (precision is then a
+// whole step size, usually 1), so large ints don't lose bits to float
+// rounding.
+
+struct Quantization
+{
+  float min;
+  float max;
+  float precision;
+
+  // Largest quantized value; the encoded range is [0, Steps()].
+  constexpr uint32_t Steps() const
+  {
+    float span = (max - min) / precision;
+    uint32_t steps = (uint32_t)span;
+    return (float)steps < span ? steps + 1 : steps;
+  }
+  constexpr int Bits() const { return bits_required(Steps()); }
+  constexpr float Scale() const { return 1.0f / precision; }
+  // Half a step, plus a few ulps of float rounding at the range's
+  // largest magnitude.
+  constexpr float MaxError() const
+  {
+    float low = min < 0 ? -min : min;
+    float high = max < 0 ? -max : max;
+    float magnitude = low > high ? low : high;
+    return precision * 0.5f + magnitude * 4.0f * FLT_EPSILON;
+  }
+};
+
+inline uint32_t quantize(float value, const Quantization& q)
+{
+  float t = (value - q.min) * q.Scale();
+  // Written so NaN lands on 0 too.
+  if (!(t > 0.0f)) return 0;
+  float steps = (float)q.Steps();
+  if (t >= steps) return q.Steps();
+  return (uint32_t)(t + 0.5f);
+}
+
+inline float dequantize(uint32_t value, const Quantization& q)
+{
+  if (value > q.Steps()) value = q.Steps();
+  return q.min + (float)value * q.precision;
+}
+
+inline uint32_t quantize_int(int64_t value, const Quantization& q)
+{
+  int64_t step = (int64_t)q.precision;
+  int64_t offset = value - (int64_t)q.min;
+  if (step < 1) step = 1;
+  if (offset <= 0) return 0;
+  uint64_t steps = (uint64_t)((offset + step / 2) / step);
+  return steps >= q.Steps() ? q.Steps() : (uint32_t)steps;
+}
+
+inline int64_t dequantize_int(uint32_t value, const Quantization& q)
+{
+  int64_t step = (int64_t)q.precision;
+  if (step < 1) step = 1;
+  if (value > q.Steps()) value = q.Steps();
+  return (int64_t)q.min + (int64_t)value * step;
+}
+
+// Batch versions, for whole arrays of positions. 8 (AVX2) or 4
+// (SSE2/NEON) values per iteration, scalar tail. They give the same
+// results as quantize()/dequantize(). Bits() must be at most 31.
+inline void quantize_array(const float* in, uint32_t* out, size_t count, const Quantization& q)
+{
+  assert(q.Bits() <= 31);
+  const float scale = q.Scale();
+  const float steps = (float)q.Steps();
+  size_t i = 0;
+#if defined(__AVX2__)
+  {
+    const __m256 vmin = _mm256_set1_ps(q.min);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    const __m256 vsteps = _mm256_set1_ps(steps);
+    const __m256 vzero = _mm256_setzero_ps();
+    const __m256 vhalf = _mm256_set1_ps(0.5f);
+    for (; i + 8 <= count; i += 8)
+    {
+      __m256 t = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(in + i), vmin), vscale);
+      // max/min take the second operand for NaN, clamping it to 0.
+      t = _mm256_min_ps(_mm256_max_ps(t, vzero), vsteps);
+      __m256i r = _mm256_cvttps_epi32(_mm256_add_ps(t, vhalf));
+      // t == steps must stay steps, not round up past it.
+      r = _mm256_min_epi32(r, _mm256_set1_epi32((int)q.Steps()));
+      _mm256_storeu_si256((__m256i*)(out + i), r);
+    }
+  }
+#endif
+#if defined(QUANTIZE_HAVE_SSE2)
+  {
+    const __m128 vmin = _mm_set1_ps(q.min);
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 vsteps = _mm_set1_ps(steps);
+    const __m128 vzero = _mm_setzero_ps();
+    const __m128 vhalf = _mm_set1_ps(0.5f);
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128 t = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(in + i), vmin), vscale);
+      t = _mm_min_ps(_mm_max_ps(t, vzero), vsteps);
+      __m128i r = _mm_cvttps_epi32(_mm_add_ps(t, vhalf));
+      // SSE2 has no 32-bit integer min; compare and blend instead.
+      __m128i vmax = _mm_set1_epi32((int)q.Steps());
+      __m128i over = _mm_cmpgt_epi32(r, vmax);
+      r = _mm_or_si128(_mm_and_si128(over, vmax), _mm_andnot_si128(over, r));
+      _mm_storeu_si128((__m128i*)(out + i), r);
+    }
+  }
+#elif defined(__ARM_NEON)
+  {
+    const float32x4_t vmin = vdupq_n_f32(q.min);
+    const float32x4_t vscale = vdupq_n_f32(scale);
+    const float32x4_t vsteps = vdupq_n_f32(steps);
+    const float32x4_t vzero = vdupq_n_f32(0.0f);
+    const float32x4_t vhalf = vdupq_n_f32(0.5f);
+    for (; i + 4 <= count; i += 4)
+    {
+      float32x4_t t = vmulq_f32(vsubq_f32(vld1q_f32(in + i), vmin), vscale);
+      // NaN survives the clamp, but converts to 0.
+      t = vminq_f32(vmaxq_f32(t, vzero), vsteps);
+      uint32x4_t r = vcvtq_u32_f32(vaddq_f32(t, vhalf));
+      vst1q_u32(out + i, vminq_u32(r, vdupq_n_u32(q.Steps())));
+    }
+  }
+#endif
+  for (; i < count; i++)
+    out[i] = quantize(in[i], q);
+}
+
+inline void dequantize_array(const uint32_t* in, float* out, size_t count, const Quantization& q)
+{
+  assert(q.Bits() <= 31);
+  size_t i = 0;
+#if defined(__AVX2__)
+  {
+    const __m256 vmin = _mm256_set1_ps(q.min);
+    const __m256 vprecision = _mm256_set1_ps(q.precision);
+    const __m256i vsteps = _mm256_set1_epi32((int)q.Steps());
+    for (; i + 8 <= count; i += 8)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+      // Unsigned clamp, so out-of-range input can't go negative.
+      v = _mm256_min_epu32(v, vsteps);
+      __m256 f = _mm256_cvtepi32_ps(v);
+      _mm256_storeu_ps(out + i, _mm256_add_ps(vmin, _mm256_mul_ps(f, vprecision)));
+    }
+  }
+#endif
+#if defined(QUANTIZE_HAVE_SSE2)
+  {
+    const __m128 vmin = _mm_set1_ps(q.min);
+    const __m128 vprecision = _mm_set1_ps(q.precision);
+    const __m128i vsteps = _mm_set1_epi32((int)q.Steps());
+    const __m128i vsign = _mm_set1_epi32((int)0x80000000u);
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+      // Unsigned compare via the sign-flip trick.
+      __m128i over = _mm_cmpgt_epi32(_mm_xor_si128(v, vsign), _mm_xor_si128(vsteps, vsign));
+      v = _mm_or_si128(_mm_and_si128(over, vsteps), _mm_andnot_si128(over, v));
+      __m128 f = _mm_cvtepi32_ps(v);
+      _mm_storeu_ps(out + i, _mm_add_ps(vmin, _mm_mul_ps(f, vprecision)));
+    }
+  }
+#elif defined(__ARM_NEON)
+  {
+    const float32x4_t vmin = vdupq_n_f32(q.min);
+    const float32x4_t vprecision = vdupq_n_f32(q.precision);
+    const uint32x4_t vsteps = vdupq_n_u32(q.Steps());
+    for (; i + 4 <= count; i += 4)
+    {
+      uint32x4_t v = vminq_u32(vld1q_u32(in + i), vsteps);
+      vst1q_f32(out + i, vaddq_f32(vmin, vmulq_f32(vcvtq_f32_u32(v), vprecision)));
+    }
+  }
+#endif
+  for (; i < count; i++)
+    out[i] = dequantize(in[i], q);
+}
+
+// Per-field declarations
+// ======================
+// Like NetFields (net_fields.h), but each field also carries its
+// range and precision:
+//
+//     template<> struct NetQuantization<GameObject> {
+//       static constexpr auto fields = std::make_tuple(
+//         NET_QUANTIZED(GameObject, x, -65536, 65535, 1),
+//         NET_QUANTIZED(GameObject, xVel, -1024, 1023, 1));
+//     };
+//
+// net_write_quantized()/net_read_quantized() then bit-pack the fields,
+// in order, into a BitWriter/BitReader.
+
+template<typename T>
+struct NetQuantization;
+
+template<typename Class, typename Member>
+struct NetQuantizedField
+{
+  typedef Member type;
+
+  Member Class::* member;
+  const char* name;
+  Quantization quantization;
+};
+
+template<typename Class, typename Member>
+constexpr NetQuantizedField<Class, Member> net_quantized_field(Member Class::* member, const char* name, Quantization quantization)
+{
+  return NetQuantizedField<Class, Member>{ member, name, quantization };
+}
+
+#define NET_QUANTIZED(Type, member, min, max, precision) \
+  net_quantized_field(&Type::member, #member, Quantization{ (float)(min), (float)(max), (float)(precision) })
+
+template<typename T, typename Fn, size_t... I>
+inline void net_for_each_quantized_impl(Fn&& fn, std::index_sequence<I...>)
+{
+  (fn(std::integral_constant<size_t, I>()), ...);
+}
+
+template<typename T, typename Fn>
+inline void net_for_each_quantized(Fn&& fn)
+{
+  constexpr size_t count = std::tuple_size<decltype(NetQuantization<T>::fields)>::value;
+  net_for_each_quantized_impl<T>(fn, std::make_index_sequence<count>());
+}
+
+template<typename T, size_t... I>
+constexpr size_t net_quantized_bits_impl(std::index_sequence<I...>)
+{
+  return (0 + ... + (size_t)std::get<I>(NetQuantization<T>::fields).quantization.Bits());
+}
+
+// Bits one T takes when quantized.
+template<typename T>
+constexpr size_t net_quantized_bits()
+{
+  constexpr size_t count = std::tuple_size<decltype(NetQuantization<T>::fields)>::value;
+  return net_quantized_bits_impl<T>(std::make_index_sequence<count>());
+}
+
+template<typename T>
+inline bool net_write_quantized(BitWriter& writer, const T& value)
+{
+  net_for_each_quantized<T>([&](auto index) {
+    constexpr auto field = std::get<decltype(index)::value>(NetQuantization<T>::fields);
+    typedef typename decltype(field)::type Field;
+    constexpr Quantization q = field.quantization;
+    constexpr int bits = q.Bits();
+    if constexpr (bits == 0) return;
+    else if constexpr (std::is_integral<Field>::value)
+      writer.WriteBits(quantize_int((int64_t)(value.*field.member), q), bits);
+    else
+      writer.WriteBits(quantize((float)(value.*field.member), q), bits);
+  });
+  return writer.ok();
+}
+
+template<typename T>
+inline bool net_read_quantized(BitReader& reader, T& value)
+{
+  net_for_each_quantized<T>([&](auto index) {
+    constexpr auto field = std::get<decltype(index)::value>(NetQuantization<T>::fields);
+    typedef typename decltype(field)::type Field;
+    constexpr Quantization q = field.quantization;
+    constexpr int bits = q.Bits();
+    uint32_t quantized = bits == 0 ? 0 : reader.ReadBits(bits);
+    if constexpr (std::is_integral<Field>::value)
+      value.*field.member = (Field)dequantize_int(quantized, q);
+    else
+      value.*field.member = (Field)dequantize(quantized, q);
+  });
+  return reader.ok();
+}
@@ -0,0 +1,89 @@
+#include "range_coder.h"
+
+// Bytes go out one behind: a byte of _low can't be written until it's
+// known no carry will reach it. A run of 0xff bytes is held back as a
+// count, since one carry turns them all to 0x00.
+void RangeEncoder::ShiftLow()
+{
+  if ((uint32_t)_low < 0xff000000u || (_low >> 32) != 0)
+  {
+    uint8_t carry = (uint8_t)(_low >> 32);
+    uint8_t byte = _cache;
+    do
+    {
+      // The first byte out is always 0 (nothing has carried into it
+      // yet), so it isn't sent; the decoder starts from the second.
+      if (_started)
+        _stream.Insert((uint8_t)(byte + carry));
+      _started = true;
+      byte = 0xff;
+    } while (--_cache_size != 0);
+    _cache = (uint8_t)(_low >> 24);
+  }
+  _cache_size++;
+  _low = (_low & 0x00ffffff) << 8;
+}
+
+bool RangeEncoder::Finish()
+{
+  for (int i = 0; i < 5; i++) ShiftLow();
+  return _stream.ok();
+}
+
+bool RangeDecoder::Init(ByteSpan data)
+{
+  _in = data.data;
+  _end = data.data + data.size;
+  _range = 0xffffffff;
+  _code = 0;
+  _overrun = data.size < 4;
+  if (_overrun) return false;
+  for (int i = 0; i < 4; i++) _code = (_code << 8) | NextByte();
+  return true;
+}
+
+static const int kLengthTreeBits = 5;
+
+void RangeIntModel::Encode(RangeEncoder& encoder, int64_t value, bool prev_zero)
+{
+  encoder.EncodeBit(zero[prev_zero], value != 0);
+  if (value == 0) return;
+  encoder.EncodeBit(sign, value < 0);
+
+  // Quantized values fit in 32 bits, so their differences' magnitudes
+  // do too.
+  uint32_t magnitude = (uint32_t)(value < 0 ? -value : value);
+  int bits = bits_required(magnitude);
+  uint32_t node = 1;
+  for (int i = kLengthTreeBits - 1; i >= 0; i--)
+  {
+    int bit = ((bits - 1) >> i) & 1;
+    encoder.EncodeBit(length[node], bit);
+    node = (node << 1) | bit;
+  }
+  if (bits < 2) return;
+  // The leading one is implied by the length. The bit after it is
+  // still skewed (small values within a length are more common), the
+  // rest are close enough to random.
+  encoder.EncodeBit(high_bit[bits], (magnitude >> (bits - 2)) & 1);
+  encoder.EncodeDirect(magnitude, bits - 2);
+}
+
+int64_t RangeIntModel::Decode(RangeDecoder& decoder, bool prev_zero)
+{
+  if (!decoder.DecodeBit(zero[prev_zero])) return 0;
+  bool negative = decoder.DecodeBit(sign) != 0;
+
+  uint32_t node = 1;
+  for (int i = 0; i < kLengthTreeBits; i++)
+    node = (node << 1) | decoder.DecodeBit(length[node]);
+  int bits = (int)(node - (1u << kLengthTreeBits)) + 1;
+
+  uint32_t magnitude = 1;
+  if (bits >= 2)
+  {
+    magnitude = (magnitude << 1) | decoder.DecodeBit(high_bit[bits]);
+    magnitude = (magnitude << (bits - 2)) | decoder.DecodeDirect(bits - 2);
+  }
+  return negative ? -(int64_t)magnitude : (int64_t)magnitude;
+}
@@ -0,0 +1,347 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "bytestream.h"
+#include "quantize.h"
+#include "wire_endian.h"
+
+// Range-coded snapshot deltas
+// ===========================
+// Quantized deltas are mostly zero, and the rest are mostly small,
+// but bit-packing pays each field's full width and varints pay at
+// least a byte. An adaptive binary range coder instead spends about
+// -log2(p) bits on a bit it predicted with probability p, so a field
+// that is zero 95% of the time costs well under a tenth of a bit.
+//
+// RangeEncoder/RangeDecoder are the LZMA coder: 32-bit range, 11-bit
+// probabilities that move 1/32 of the way towards each bit seen.
+// RangeIntModel turns a signed integer into bits, each with its own
+// adaptive probability:
+//
+//     zero?   (two contexts: whether the previous field was zero)
+//     sign
+//     bit length, 1..32, as a 5-level binary tree
+//     the bit below the leading one (one context per bit length),
+//     then the remaining low bits at a flat 50%
+//
+// write_range_coded_deltas() codes every NetQuantization field of a
+// batch of objects against their baselines, with one RangeIntModel
+// per field. Models start fresh in every message, so a lost packet
+// never leaves the two ends with different statistics.
+//
+// Decoding is one long dependency chain per coder. To give the CPU
+// more than one chain to work on, objects are dealt round-robin into
+// up to kMaxRangeStreams independent streams, and the decoder steps
+// through them in lockstep, one field of each stream in turn.
+//
+// Wire format:
+//
+//     uint8   stream count
+//     per stream:
+//       uint32  byte length
+//       ...     range coder output
+
+class RangeEncoder
+{
+ public:
+  static const int kProbBits = 11;
+  static const uint16_t kProbInit = 1 << (kProbBits - 1);
+
+  explicit RangeEncoder(OutByteStream& stream)
+    : _stream(stream), _low(0), _range(0xffffffff), _cache(0), _cache_size(1), _started(false) {}
+
+  // Codes bit with probability prob/2048 of being 0, then moves prob
+  // towards what was seen.
+  void EncodeBit(uint16_t& prob, int bit)
+  {
+    uint32_t bound = (_range >> kProbBits) * prob;
+    if (bit == 0)
+    {
+      _range = bound;
+      prob += ((1 << kProbBits) - prob) >> kMoveBits;
+    }
+    else
+    {
+      _low += bound;
+      _range -= bound;
+      prob -= prob >> kMoveBits;
+    }
+    Normalize();
+  }
+
+  // The low `bits` bits of value at a flat 50%, high bit first.
+  void EncodeDirect(uint32_t value, int bits)
+  {
+    while (bits-- > 0)
+    {
+      _range >>= 1;
+      if ((value >> bits) & 1) _low += _range;
+      Normalize();
+    }
+  }
+
+  // Writes out what's left. Returns stream.ok().
+  bool Finish();
+
+ private:
+  static const int kMoveBits = 5;
+
+  void Normalize()
+  {
+    while (_range < (1u << 24))
+    {
+      _range <<= 8;
+      ShiftLow();
+    }
+  }
+
+  void ShiftLow();
+
+  OutByteStream& _stream;
+  uint64_t _low;
+  uint32_t _range;
+  uint8_t _cache;
+  uint64_t _cache_size;
+  bool _started;
+};
+
+class RangeDecoder
+{
+ public:
+  RangeDecoder(): _in(nullptr), _end(nullptr), _range(0), _code(0), _overrun(false) {}
+
+  // Starts decoding data. False if it's too short to be coder output.
+  // data must outlive the decoder.
+  bool Init(ByteSpan data);
+
+  int DecodeBit(uint16_t& prob)
+  {
+    uint32_t bound = (_range >> RangeEncoder::kProbBits) * prob;
+    int bit;
+    if (_code < bound)
+    {
+      _range = bound;
+      prob += ((1 << RangeEncoder::kProbBits) - prob) >> kMoveBits;
+      bit = 0;
+    }
+    else
+    {
+      _code -= bound;
+      _range -= bound;
+      prob -= prob >> kMoveBits;
+      bit = 1;
+    }
+    Normalize();
+    return bit;
+  }
+
+  uint32_t DecodeDirect(int bits)
+  {
+    uint32_t value = 0;
+    while (bits-- > 0)
+    {
+      _range >>= 1;
+      uint32_t bit = _code >= _range ? 1 : 0;
+      _code -= _range & (0 - bit);
+      value = (value << 1) | bit;
+      Normalize();
+    }
+    return value;
+  }
+
+  // False if decoding ran past the end of the data, i.e. the data was
+  // truncated or wasn't coded the way it's being decoded.
+  bool ok() const { return !_overrun; }
+
+ private:
+  static const int kMoveBits = 5;
+
+  void Normalize()
+  {
+    if (_range < (1u << 24))
+    {
+      _range <<= 8;
+      _code = (_code << 8) | NextByte();
+    }
+  }
+
+  uint8_t NextByte()
+  {
+    if (_in == _end)
+    {
+      _overrun = true;
+      return 0;
+    }
+    return (uint8_t)*_in++;
+  }
+
+  const char* _in;
+  const char* _end;
+  uint32_t _range;
+  uint32_t _code;
+  bool _overrun;
+};
+
+// Adaptive model for one signed integer field. Call Reset() before
+// first use.
+struct RangeIntModel
+{
+  uint16_t zero[2];
+  uint16_t sign;
+  // Nodes 1..31 of the bit-length tree.
+  uint16_t length[32];
+  uint16_t high_bit[33];
+
+  // Every probability back to 50%. Copied from a ready-made model,
+  // since filling the small arrays one by one costs more than the
+  // coding in a short message.
+  void Reset();
+
+  // prev_zero selects the zero flag's context.
+  void Encode(RangeEncoder& encoder, int64_t value, bool prev_zero);
+  int64_t Decode(RangeDecoder& decoder, bool prev_zero);
+};
+
+constexpr RangeIntModel fresh_range_int_model()
+{
+  RangeIntModel model{};
+  model.zero[0] = model.zero[1] = model.sign = RangeEncoder::kProbInit;
+  for (uint16_t& prob : model.length) prob = RangeEncoder::kProbInit;
+  for (uint16_t& prob : model.high_bit) prob = RangeEncoder::kProbInit;
+  return model;
+}
+
+inline void RangeIntModel::Reset()
+{
+  static constexpr RangeIntModel fresh = fresh_range_int_model();
+  *this = fresh;
+}
+
+const int kMaxRangeStreams = 4;
+
+// Field I of object, quantized.
+template<typename T, size_t I>
+inline int64_t net_quantized_value(const T& object)
+{
+  constexpr auto field = std::get<I>(NetQuantization<T>::fields);
+  typedef typename decltype(field)::type Field;
+  constexpr Quantization q = field.quantization;
+  if constexpr (std::is_integral<Field>::value)
+    return quantize_int((int64_t)(object.*field.member), q);
+  else
+    return quantize((float)(object.*field.member), q);
+}
+
+// Sets field I of object from a quantized value. Out-of-range values
+// (only from corrupt input) clamp like any other.
+template<typename T, size_t I>
+inline void net_set_quantized_value(T& object, int64_t value)
+{
+  constexpr auto field = std::get<I>(NetQuantization<T>::fields);
+  typedef typename decltype(field)::type Field;
+  constexpr Quantization q = field.quantization;
+  uint32_t quantized = value < 0 ? 0 : value > (int64_t)q.Steps() ? q.Steps() : (uint32_t)value;
+  if constexpr (std::is_integral<Field>::value)
+    object.*field.member = (Field)dequantize_int(quantized, q);
+  else
+    object.*field.member = (Field)dequantize(quantized, q);
+}
+
+template<typename T>
+struct RangeModels
+{
+  static constexpr size_t kNumFields = std::tuple_size<decltype(NetQuantization<T>::fields)>::value;
+  RangeIntModel fields[kNumFields];
+
+  void Reset()
+  {
+    for (RangeIntModel& model : fields) model.Reset();
+  }
+};
+
+// Codes count objects against baselines (which may be null, as may
+// any baselines[i]; a missing baseline is all zeros). num_streams is
+// clamped to [1, kMaxRangeStreams], and to count. Each stream costs
+// 4 bytes of length and about 4 of coder flush, so a handful of
+// objects is best sent as one.
+template<typename T>
+bool write_range_coded_deltas(OutByteStream& stream, const T* const* objects, const T* const* baselines,
+                              size_t count, int num_streams = kMaxRangeStreams)
+{
+  if (num_streams < 1) num_streams = 1;
+  if (num_streams > kMaxRangeStreams) num_streams = kMaxRangeStreams;
+  if (count > 0 && (size_t)num_streams > count) num_streams = (int)count;
+  stream.Insert((uint8_t)num_streams);
+
+  for (int s = 0; s < num_streams; s++)
+  {
+    size_t length_pos = stream.size();
+    if (!stream.Insert((uint32_t)0)) return false;
+    size_t start = stream.size();
+
+    RangeEncoder encoder(stream);
+    RangeModels<T> models;
+    models.Reset();
+    for (size_t i = s; i < count; i += num_streams)
+    {
+      const T* baseline = baselines ? baselines[i] : nullptr;
+      bool prev_zero = true;
+      net_for_each_quantized<T>([&](auto index) {
+        int64_t delta = net_quantized_value<T, decltype(index)::value>(*objects[i]);
+        if (baseline) delta -= net_quantized_value<T, decltype(index)::value>(*baseline);
+        models.fields[index].Encode(encoder, delta, prev_zero);
+        prev_zero = delta == 0;
+      });
+    }
+    if (!encoder.Finish()) return false;
+    store_le(stream.data() + length_pos, (uint32_t)(stream.size() - start));
+  }
+  return stream.ok();
+}
+
+// Decodes count objects into objects[], against the same baselines
+// the sender used. False for truncated or malformed input; objects
+// may then be partly written.
+template<typename T>
+bool read_range_coded_deltas(InByteStream& stream, T* const* objects, const T* const* baselines, size_t count)
+{
+  uint8_t num_streams = 0;
+  if (!stream.Read(num_streams) || num_streams < 1 || num_streams > kMaxRangeStreams) return false;
+
+  RangeDecoder decoders[kMaxRangeStreams];
+  RangeModels<T> models[kMaxRangeStreams];
+  for (int s = 0; s < num_streams; s++)
+  {
+    models[s].Reset();
+    uint32_t length = 0;
+    stream.Read(length);
+    ByteSpan data = stream.ReadSpan(length);
+    if (!stream.ok() || !decoders[s].Init(data)) return false;
+  }
+
+  for (size_t i = 0; i < count; i += num_streams)
+  {
+    size_t lanes = count - i < (size_t)num_streams ? count - i : (size_t)num_streams;
+    bool prev_zero[kMaxRangeStreams] = { true, true, true, true };
+    // One field of each stream's object in turn, so the decoders'
+    // dependency chains overlap.
+    net_for_each_quantized<T>([&](auto index) {
+      for (size_t s = 0; s < lanes; s++)
+      {
+        int64_t value = models[s].fields[index].Decode(decoders[s], prev_zero[s]);
+        prev_zero[s] = value == 0;
+        const T* baseline = baselines ? baselines[i + s] : nullptr;
+        if (baseline) value += net_quantized_value<T, decltype(index)::value>(*baseline);
+        net_set_quantized_value<T, decltype(index)::value>(*objects[i + s], value);
+      }
+    });
+  }
+
+  for (int s = 0; s < num_streams; s++)
+    if (!decoders[s].ok()) return false;
+  return true;
+}
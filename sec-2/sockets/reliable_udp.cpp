@@ -0,0 +1,287 @@
+#include "reliable_udp.h"
+#include <utility>
+
+// Resend timeout before the first round trip is measured, and the
+// bounds on it after.
+static const double kInitialResendTimeout = 0.2;
+static const double kMinResendTimeout = 0.02;
+static const double kMaxResendTimeout = 1.0;
+
+ReliableConnection::ReliableConnection(Socket& socket, const Address& peer):
+  _socket(socket),
+  _peer(peer),
+  _local_sequence(0),
+  _current(nullptr),
+  _have_remote(false),
+  // Acks "packet 65535" until something arrives. That packet hasn't
+  // been sent, so the ack matches nothing.
+  _remote_sequence(0xffff),
+  _remote_ack_bits(0),
+  _have_rtt(false),
+  _srtt(0),
+  _rttvar(0),
+  _rto(kInitialResendTimeout)
+{
+}
+
+bool ReliableConnection::Send(Channel channel, const char* data, size_t len)
+{
+  if (len > kMaxReliableMessageSize || channel >= NUM_CHANNELS) return false;
+  if (channel == UNRELIABLE)
+  {
+    _unreliable.emplace_back(data, len);
+    return true;
+  }
+
+  SendChannel& c = _send[channel - RELIABLE_UNORDERED];
+  if ((uint16_t)(c.next_id - c.oldest_unacked) >= kReliableWindow) return false;
+  PendingMessage& message = c.window[c.next_id % kReliableWindow];
+  message.data.assign(data, len);
+  message.id = c.next_id;
+  message.in_use = true;
+  message.last_sent = -1;
+  c.next_id++;
+  return true;
+}
+
+// ==== Sending ====
+
+void ReliableConnection::BeginPacket(OutByteStream& packet, double now)
+{
+  packet.clear();
+  packet.Insert(_local_sequence);
+  packet.Insert(_remote_sequence);
+  packet.Insert(_remote_ack_bits);
+
+  _current = &_sent[_local_sequence % kSentPacketHistory];
+  _current->sequence = _local_sequence;
+  _current->valid = true;
+  _current->acked = false;
+  _current->time = now;
+  _current->messages.clear();
+}
+
+void ReliableConnection::FinishPacket(OutByteStream& packet)
+{
+  _socket.SendTo(packet.data(), packet.size(), _peer);
+  _stats.packets_sent++;
+  _local_sequence++;
+}
+
+bool ReliableConnection::WriteMessage(OutByteStream& packet, Channel channel, uint16_t id, const ByteString& data)
+{
+  size_t header = 1 + (channel == UNRELIABLE ? 0 : 2) + varint_size(data.size());
+  if (packet.size() + header + data.size() > kMaxReliablePacketSize) return false;
+  packet.Insert((uint8_t)channel);
+  if (channel != UNRELIABLE) packet.Insert(id);
+  packet.InsertVarint(data.size());
+  return packet.InsertBytes(data.data(), data.size());
+}
+
+int ReliableConnection::Update(double now)
+{
+  char buffer[kMaxReliablePacketSize];
+  OutByteStream packet(buffer, sizeof(buffer));
+  int sent = 0;
+  BeginPacket(packet, now);
+
+  for (int index = 0; index < NUM_CHANNELS - 1; index++)
+  {
+    Channel channel = (Channel)(RELIABLE_UNORDERED + index);
+    SendChannel& c = _send[index];
+    for (uint16_t id = c.oldest_unacked; id != c.next_id; id++)
+    {
+      PendingMessage& message = c.window[id % kReliableWindow];
+      if (!message.in_use) continue;
+      if (message.last_sent >= 0 && now - message.last_sent < _rto) continue;
+
+      if (!WriteMessage(packet, channel, id, message.data))
+      {
+        FinishPacket(packet);
+        sent++;
+        BeginPacket(packet, now);
+        WriteMessage(packet, channel, id, message.data);
+      }
+      if (message.last_sent >= 0) _stats.messages_resent++;
+      message.last_sent = now;
+      _current->messages.push_back(MessageRef{ (uint8_t)channel, id });
+    }
+  }
+
+  for (const ByteString& data : _unreliable)
+  {
+    if (!WriteMessage(packet, UNRELIABLE, 0, data))
+    {
+      FinishPacket(packet);
+      sent++;
+      BeginPacket(packet, now);
+      WriteMessage(packet, UNRELIABLE, 0, data);
+    }
+  }
+  _unreliable.clear();
+
+  FinishPacket(packet);
+  return sent + 1;
+}
+
+// ==== Acks ====
+
+void ReliableConnection::UpdateRtt(double sample)
+{
+  // RFC 6298.
+  if (!_have_rtt)
+  {
+    _srtt = sample;
+    _rttvar = sample / 2;
+    _have_rtt = true;
+  }
+  else
+  {
+    double error = sample > _srtt ? sample - _srtt : _srtt - sample;
+    _rttvar = 0.75 * _rttvar + 0.25 * error;
+    _srtt = 0.875 * _srtt + 0.125 * sample;
+  }
+  _rto = _srtt + 4 * _rttvar;
+  if (_rto < kMinResendTimeout) _rto = kMinResendTimeout;
+  if (_rto > kMaxResendTimeout) _rto = kMaxResendTimeout;
+}
+
+void ReliableConnection::OnPacketAcked(uint16_t sequence, double now)
+{
+  SentPacket& packet = _sent[sequence % kSentPacketHistory];
+  if (!packet.valid || packet.sequence != sequence || packet.acked) return;
+  packet.acked = true;
+  _stats.packets_acked++;
+  // Packets are never resent, so every ack is a clean sample.
+  UpdateRtt(now - packet.time);
+  for (const MessageRef& ref : packet.messages)
+    OnMessageAcked((Channel)ref.channel, ref.id);
+}
+
+void ReliableConnection::OnMessageAcked(Channel channel, uint16_t id)
+{
+  SendChannel& c = _send[channel - RELIABLE_UNORDERED];
+  PendingMessage& message = c.window[id % kReliableWindow];
+  if (!message.in_use || message.id != id) return;
+  message.in_use = false;
+  message.data.clear();
+  while (c.oldest_unacked != c.next_id && !c.window[c.oldest_unacked % kReliableWindow].in_use)
+    c.oldest_unacked++;
+}
+
+// ==== Receiving ====
+
+// Reads the next message of a packet. False if it's malformed.
+static bool read_packet_message(InByteStream& in, uint8_t& channel, uint16_t& id, ByteSpan& message)
+{
+  uint32_t size = 0;
+  id = 0;
+  if (!in.Read(channel) || channel >= ReliableConnection::NUM_CHANNELS) return false;
+  if (channel != ReliableConnection::UNRELIABLE) in.Read(id);
+  in.ReadVarint(size);
+  if (!in.ok() || size > kMaxReliableMessageSize) return false;
+  message = in.ReadSpan(size);
+  return in.ok();
+}
+
+bool ReliableConnection::ProcessPacket(const char* data, size_t len, double now)
+{
+  InByteStream in(data, len);
+  uint16_t sequence = 0;
+  uint16_t ack = 0;
+  uint32_t ack_bits = 0;
+  in.Read(sequence);
+  in.Read(ack);
+  in.Read(ack_bits);
+  if (!in.ok()) return false;
+
+  // Check every message before acting on any of it. Acking a packet
+  // we then only half delivered would lose the rest for good: the
+  // peer stops resending whatever an acked packet carried.
+  uint8_t channel = 0;
+  uint16_t id = 0;
+  ByteSpan message{ nullptr, 0 };
+  InByteStream check = in;
+  while (check.bytes_remaining() > 0)
+    if (!read_packet_message(check, channel, id, message)) return false;
+  _stats.packets_received++;
+
+  OnPacketAcked(ack, now);
+  for (int i = 0; i < 32; i++)
+    if (ack_bits & (1u << i)) OnPacketAcked((uint16_t)(ack - 1 - i), now);
+
+  // Note the sequence for our acks. A duplicate, or one too old to
+  // tell, has nothing new to deliver: its reliable messages were
+  // delivered or will be resent, and its unreliable ones are stale.
+  if (!_have_remote || sequence_greater_than(sequence, _remote_sequence))
+  {
+    uint16_t shift = _have_remote ? (uint16_t)(sequence - _remote_sequence) : 33;
+    uint64_t bits = shift > 32 ? 0 : (((uint64_t)_remote_ack_bits << shift) | (1ull << (shift - 1)));
+    _remote_ack_bits = (uint32_t)bits;
+    _remote_sequence = sequence;
+    _have_remote = true;
+  }
+  else
+  {
+    uint16_t behind = (uint16_t)(_remote_sequence - sequence);
+    if (behind == 0 || behind > 32) return true;
+    uint32_t bit = 1u << (behind - 1);
+    if (_remote_ack_bits & bit) return true;
+    _remote_ack_bits |= bit;
+  }
+
+  while (in.bytes_remaining() > 0)
+  {
+    // Can't fail: the same reads passed above.
+    read_packet_message(in, channel, id, message);
+    if (channel == UNRELIABLE)
+      _inbox.push_back(Message{ UNRELIABLE, ByteString(message.data, message.size) });
+    else
+      OnReliableMessage((Channel)channel, id, message);
+  }
+  return true;
+}
+
+void ReliableConnection::OnReliableMessage(Channel channel, uint16_t id, ByteSpan data)
+{
+  ReceiveChannel& c = _receive[channel - RELIABLE_UNORDERED];
+  // The sender never has more than the window in flight past the
+  // oldest message it hasn't seen acked, which is at or before
+  // next_id. Anything outside the window was delivered already.
+  if ((uint16_t)(id - c.next_id) >= kReliableWindow)
+  {
+    _stats.duplicates++;
+    return;
+  }
+  ReceivedSlot& slot = c.window[id % kReliableWindow];
+  if (slot.received)
+  {
+    _stats.duplicates++;
+    return;
+  }
+
+  slot.received = true;
+  if (channel == RELIABLE_UNORDERED)
+    _inbox.push_back(Message{ channel, ByteString(data.data, data.size) });
+  else
+    slot.data.assign(data.data, data.size);
+
+  // Ordered messages go out once everything before them has arrived;
+  // unordered ones only need the window to move on.
+  while (c.window[c.next_id % kReliableWindow].received)
+  {
+    ReceivedSlot& next = c.window[c.next_id % kReliableWindow];
+    if (channel == RELIABLE_ORDERED) _inbox.push_back(Message{ channel, std::move(next.data) });
+    next.received = false;
+    next.data.clear();
+    c.next_id++;
+  }
+}
+
+bool ReliableConnection::Receive(Message& message)
+{
+  if (_inbox.empty()) return false;
+  message = std::move(_inbox.front());
+  _inbox.pop_front();
+  return true;
+}
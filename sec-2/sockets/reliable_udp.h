@@ -0,0 +1,202 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "bytestream.h"
+#include "socklib.h"
+
+// Reliable channels over UDP
+// ==========================
+// TCP makes everything reliable and ordered, so one lost packet holds
+// up everything behind it -- including position updates that are
+// stale by the time they get through. Raw datagrams guarantee
+// nothing. ReliableConnection sits in between: messages go on one of
+// three channels,
+//
+//     UNRELIABLE          sent once; lost or late, never resent
+//     RELIABLE_UNORDERED  resent until acked, delivered on arrival
+//     RELIABLE_ORDERED    resent until acked, delivered in send order
+//
+// and share the same packets, so a lost chat message only ever holds
+// up later chat messages.
+//
+// Every packet carries its own sequence number and acks the peer's:
+// the latest sequence received plus a 32-bit field for the 32 before
+// it, so each ack is repeated in ~33 packets and a lost packet
+// hardly ever costs an ack. Packets themselves are never resent. A
+// reliable message stays queued until a packet carrying it is acked,
+// and goes out again in whatever packet is next once ResendTimeout()
+// passes without that happening. The timeout follows the measured
+// round trip (TCP-style smoothed RTT plus four deviations).
+//
+// Each reliable channel keeps at most kReliableWindow messages in
+// flight; Send() refuses more until the oldest is acked. That bounds
+// the receiver's reorder buffer to the same size.
+//
+// Packet format, integers little-endian:
+//
+//     uint16  sequence
+//     uint16  ack: latest sequence received from the peer
+//     uint32  ack bits: bit i set if ack - 1 - i was received
+//     messages, to the end of the packet:
+//       uint8   channel
+//       uint16  message id (reliable channels only)
+//       varint  length
+//       ...     payload
+
+const size_t kMaxReliablePacketSize = 1200;
+const size_t kReliablePacketHeaderSize = 8;
+// Room for the biggest message header (channel, id, 2-byte length).
+const size_t kMaxReliableMessageSize = kMaxReliablePacketSize - kReliablePacketHeaderSize - 5;
+const uint16_t kReliableWindow = 256;
+// Sent packets remembered for matching acks to their messages.
+const uint16_t kSentPacketHistory = 1024;
+
+// Whether sequence a is after b, allowing for wraparound.
+inline bool sequence_greater_than(uint16_t a, uint16_t b)
+{
+  return a != b && (uint16_t)(a - b) < 0x8000;
+}
+
+class ReliableConnection
+{
+ public:
+  enum Channel
+  {
+    UNRELIABLE,
+    RELIABLE_UNORDERED,
+    RELIABLE_ORDERED,
+    NUM_CHANNELS
+  };
+
+  struct Message
+  {
+    Channel channel;
+    ByteString data;
+  };
+
+  struct Stats
+  {
+    size_t packets_sent = 0;
+    size_t packets_received = 0;
+    size_t packets_acked = 0;
+    // Reliable messages sent again after a timeout.
+    size_t messages_resent = 0;
+    // Received messages dropped as already delivered.
+    size_t duplicates = 0;
+  };
+
+  // Packets go to peer through socket (a DGRAM socket, which may be
+  // shared with other connections). Receiving is up to the caller:
+  // hand this connection's datagrams to ProcessPacket().
+  ReliableConnection(Socket& socket, const Address& peer);
+
+  ReliableConnection(const ReliableConnection& other) = delete;
+  ReliableConnection& operator=(const ReliableConnection& other) = delete;
+
+  // Queues a message. Returns false (and queues nothing) if it's over
+  // kMaxReliableMessageSize or the channel already has
+  // kReliableWindow messages unacked.
+  bool Send(Channel channel, const char* data, size_t len);
+  bool Send(Channel channel, ByteSpan message) { return Send(channel, message.data, message.size); }
+
+  // Sends queued unreliable messages and due reliable ones, in as
+  // few packets as fit. Call once per tick; it always sends at least
+  // one packet, so acks keep flowing when there's nothing to say.
+  // now is in seconds, from any steady clock. Returns packets sent.
+  int Update(double now);
+
+  // Takes one datagram from the peer: reads its acks and queues its
+  // messages for Receive(). Returns false for a malformed packet,
+  // which is dropped whole: not acked, and none of it delivered.
+  bool ProcessPacket(const char* data, size_t len, double now);
+
+  // Pops the next delivered message.
+  bool Receive(Message& message);
+
+  // Smoothed round trip, or 0 before the first ack.
+  double Rtt() const { return _have_rtt ? _srtt : 0; }
+  double ResendTimeout() const { return _rto; }
+  const Stats& GetStats() const { return _stats; }
+  const Address& Peer() const { return _peer; }
+
+ private:
+  struct PendingMessage
+  {
+    ByteString data;
+    uint16_t id = 0;
+    bool in_use = false;
+    // Negative until first sent.
+    double last_sent = -1;
+  };
+
+  struct SendChannel
+  {
+    PendingMessage window[kReliableWindow];
+    uint16_t next_id = 0;
+    uint16_t oldest_unacked = 0;
+  };
+
+  struct ReceivedSlot
+  {
+    ByteString data;
+    bool received = false;
+  };
+
+  struct ReceiveChannel
+  {
+    ReceivedSlot window[kReliableWindow];
+    // Every id before this one has been received.
+    uint16_t next_id = 0;
+  };
+
+  struct MessageRef
+  {
+    uint8_t channel;
+    uint16_t id;
+  };
+
+  struct SentPacket
+  {
+    uint16_t sequence = 0;
+    bool valid = false;
+    bool acked = false;
+    double time = 0;
+    // The reliable messages it carried. Reused, like the slots.
+    std::vector<MessageRef> messages;
+  };
+
+  void BeginPacket(OutByteStream& packet, double now);
+  void FinishPacket(OutByteStream& packet);
+  bool WriteMessage(OutByteStream& packet, Channel channel, uint16_t id, const ByteString& data);
+  void OnPacketAcked(uint16_t sequence, double now);
+  void OnMessageAcked(Channel channel, uint16_t id);
+  void OnReliableMessage(Channel channel, uint16_t id, ByteSpan data);
+  void UpdateRtt(double sample);
+
+  Socket& _socket;
+  Address _peer;
+
+  uint16_t _local_sequence;
+  SentPacket _sent[kSentPacketHistory];
+  SentPacket* _current;
+
+  bool _have_remote;
+  uint16_t _remote_sequence;
+  uint32_t _remote_ack_bits;
+
+  // Indexed by channel - RELIABLE_UNORDERED.
+  SendChannel _send[NUM_CHANNELS - 1];
+  ReceiveChannel _receive[NUM_CHANNELS - 1];
+  std::vector<ByteString> _unreliable;
+  std::deque<Message> _inbox;
+
+  bool _have_rtt;
+  double _srtt;
+  double _rttvar;
+  double _rto;
+
+  Stats _stats;
+};
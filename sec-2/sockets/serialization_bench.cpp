@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "allocators.h"
+#include "bytestream.h"
+#include "game_object.h"
+#include "lz_codec.h"
+#include "net_text.h"
+#include "range_coder.h"
+#include "soa_codec.h"
+
+// Serialization benchmark
+// =======================
+// Encodes and decodes 1, 1k and 1M GameObjects with every encoding in
+// game_object.h, plus the bulk text and column codecs, and the batch
+// encodings again with LZ compression (lz_codec.h), and the
+// quantized deltas against the previous tick, as varints and range
+// coded (range_coder.h). Prints one JSON record per (encoding, count):
+//
+//     encode_ns / decode_ns        wall time per object
+//     bytes                        encoded size per object
+//     encode_allocs / decode_allocs  heap allocations per object, from
+//                                  the allocators.cpp gauges
+//     encode_gbps / decode_gbps    GB/s of object state (the 24 bytes
+//                                  of networked fields), so encodings
+//                                  are compared on the same work
+//
+// Every measurement follows one untimed warm-up pass, so buffers that
+// are reused between ticks (the column vectors) don't count as
+// per-object allocations. The allocation tracker itself adds a hash
+// table insert to every allocation, which makes the encodings that
+// allocate look somewhat slower than they would in a normal build.
+//
+// Every encoding but "string" is meant to be allocation free, and is
+// timed under a ZeroAllocationScope: one that starts allocating gets
+// "ok": false and the bench exits nonzero.
+//
+// Build the SerializationBench target in Release; the default
+// CMake build type here is Debug. The allocation tracker prints a leak
+// report to stdout at exit, so pass a path to get the JSON on its own:
+//
+//     SerializationBench results.json
+
+typedef std::chrono::steady_clock bench_clock;
+
+// Big enough for any one GameObject in any encoding.
+const size_t kMaxObjectBytes = 96;
+
+// Roughly a million objects encoded per measurement, whatever the
+// batch size.
+const size_t kObjectsPerMeasurement = 1000000;
+
+struct BenchBuffers {
+	std::vector<GameObject> objects;
+	std::vector<const GameObject*> object_ptrs;
+	std::vector<GameObject> decoded;
+	std::vector<GameObject*> decoded_ptrs;
+	// The same objects a tick earlier, for the delta encodings.
+	std::vector<GameObject> baselines;
+	std::vector<const GameObject*> baseline_ptrs;
+	std::vector<char> buffer;
+	std::vector<char> packed;
+	NetColumns<GameObject> columns;
+};
+
+struct Encoding {
+	const char* name;
+	// Returns the bytes written, or 0 on failure.
+	size_t (*encode)(BenchBuffers& b);
+	// Decodes len bytes of b.buffer into b.decoded.
+	bool (*decode)(BenchBuffers& b, size_t len);
+	// Whether the timed passes run under a ZeroAllocationScope.
+	bool allocation_free;
+};
+
+// The per-object encodings, back to back in one buffer. Text isn't
+// self-delimiting, so it gets a one-byte length in front.
+template <size_t (*Serialize)(const GameObject*, char*, size_t), bool kLengthPrefix>
+size_t encode_each(BenchBuffers& b)
+{
+	char* out = b.buffer.data();
+	size_t size = b.buffer.size();
+	size_t pos = 0;
+	for (const GameObject& go : b.objects) {
+		size_t header = kLengthPrefix ? 1 : 0;
+		size_t n = Serialize(&go, out + pos + header, size - pos - header);
+		if (n == 0 || n > 255) return 0;
+		if (kLengthPrefix) out[pos] = (char)n;
+		pos += header + n;
+	}
+	return pos;
+}
+
+template <size_t (*Deserialize)(GameObject*, const char*, size_t), bool kLengthPrefix>
+bool decode_each(BenchBuffers& b, size_t len)
+{
+	const char* in = b.buffer.data();
+	size_t pos = 0;
+	for (GameObject& go : b.decoded) {
+		size_t available = len - pos;
+		if (kLengthPrefix) {
+			if (available == 0) return false;
+			available = (unsigned char)in[pos++];
+			if (available > len - pos) return false;
+		}
+		size_t n = Deserialize(&go, in + pos, available);
+		if (n == 0) return false;
+		pos += n;
+	}
+	return pos == len;
+}
+
+// Bulk text: the whole batch as one line.
+size_t encode_text_line(BenchBuffers& b)
+{
+	return net_format_text_line(b.buffer.data(), b.buffer.size(), b.objects.data(), b.objects.size());
+}
+
+bool decode_text_line(BenchBuffers& b, size_t len)
+{
+	size_t count = 0;
+	size_t used = net_parse_text_line(b.buffer.data(), len, b.decoded.data(), b.decoded.size(), count);
+	return used == len && count == b.decoded.size();
+}
+
+size_t encode_columns(BenchBuffers& b)
+{
+	net_gather_columns(b.object_ptrs.data(), b.object_ptrs.size(), b.columns);
+	OutByteStream stream(b.buffer.data(), b.buffer.size());
+	if (!write_columns(stream, b.columns)) return 0;
+	return stream.size();
+}
+
+bool decode_columns(BenchBuffers& b, size_t len)
+{
+	InByteStream stream(b.buffer.data(), len);
+	if (!read_columns(stream, b.columns, b.decoded.size())) return false;
+	if (b.columns.count != b.decoded.size()) return false;
+	net_scatter_columns(b.columns, b.decoded_ptrs.data());
+	return true;
+}
+
+// Each quantized field minus the baseline's, as a zigzag varint: the
+// cheap way to send a delta, for comparison with range coding.
+size_t encode_delta_varints(BenchBuffers& b)
+{
+	OutByteStream stream(b.buffer.data(), b.buffer.size());
+	for (size_t i = 0; i < b.objects.size(); i++) {
+		net_for_each_quantized<GameObject>([&](auto index) {
+			constexpr size_t I = decltype(index)::value;
+			stream.InsertZigZag(net_quantized_value<GameObject, I>(b.objects[i]) - net_quantized_value<GameObject, I>(b.baselines[i]));
+		});
+	}
+	return stream.ok() ? stream.size() : 0;
+}
+
+bool decode_delta_varints(BenchBuffers& b, size_t len)
+{
+	InByteStream stream(b.buffer.data(), len);
+	for (size_t i = 0; i < b.decoded.size(); i++) {
+		net_for_each_quantized<GameObject>([&](auto index) {
+			constexpr size_t I = decltype(index)::value;
+			int64_t delta = 0;
+			stream.ReadZigZag(delta);
+			net_set_quantized_value<GameObject, I>(b.decoded[i], net_quantized_value<GameObject, I>(b.baselines[i]) + delta);
+		});
+	}
+	return stream.ok() && stream.bytes_remaining() == 0;
+}
+
+template <int kStreams>
+size_t encode_range_coded(BenchBuffers& b)
+{
+	OutByteStream stream(b.buffer.data(), b.buffer.size());
+	if (!write_range_coded_deltas(stream, b.object_ptrs.data(), b.baseline_ptrs.data(), b.objects.size(), kStreams)) return 0;
+	return stream.size();
+}
+
+template <int kStreams>
+bool decode_range_coded(BenchBuffers& b, size_t len)
+{
+	InByteStream stream(b.buffer.data(), len);
+	if (!read_range_coded_deltas(stream, b.decoded_ptrs.data(), b.baseline_ptrs.data(), b.decoded.size())) return false;
+	return stream.bytes_remaining() == 0;
+}
+
+// Any of the batch encodings, then LZ-compressed as a FramedSocket
+// with compression on would send it (flag byte, and only above the
+// default threshold).
+template <size_t (*Encode)(BenchBuffers&)>
+size_t encode_packed(BenchBuffers& b)
+{
+	size_t len = Encode(b);
+	if (len == 0) return 0;
+	return pack_payload(b.buffer.data(), len, b.packed.data(), b.packed.size(), kDefaultCompressionThreshold);
+}
+
+template <bool (*Decode)(BenchBuffers&, size_t)>
+bool decode_packed(BenchBuffers& b, size_t len)
+{
+	ByteSpan payload;
+	if (!unpack_payload(ByteSpan{ b.packed.data(), len }, b.buffer.data(), b.buffer.size(), payload)) return false;
+	if (payload.data != b.buffer.data()) memcpy(b.buffer.data(), payload.data, payload.size);
+	return Decode(b, payload.size);
+}
+
+const Encoding kEncodings[] = {
+	{ "string", encode_each<SerializeGameObjectAsString, true>, decode_each<DeserializeGameObjectAsString, true>, false },
+	{ "text", encode_each<SerializeGameObjectAsText, true>, decode_each<DeserializeGameObjectAsText, true>, true },
+	{ "text_bulk", encode_text_line, decode_text_line, true },
+	{ "bytes", encode_each<SerializeGameObjectAsBytes, false>, decode_each<DeserializeGameObjectAsBytes, false>, true },
+	{ "varints", encode_each<SerializeGameObjectAsVarints, false>, decode_each<DeserializeGameObjectAsVarints, false>, true },
+	{ "quantized", encode_each<SerializeGameObjectQuantized, false>, decode_each<DeserializeGameObjectQuantized, false>, true },
+	{ "columns", encode_columns, decode_columns, true },
+	{ "bytes+lz", encode_packed<encode_each<SerializeGameObjectAsBytes, false>>, decode_packed<decode_each<DeserializeGameObjectAsBytes, false>>, true },
+	{ "varints+lz", encode_packed<encode_each<SerializeGameObjectAsVarints, false>>, decode_packed<decode_each<DeserializeGameObjectAsVarints, false>>, true },
+	{ "columns+lz", encode_packed<encode_columns>, decode_packed<decode_columns>, true },
+	{ "delta_varints", encode_delta_varints, decode_delta_varints, true },
+	{ "delta_rc1", encode_range_coded<1>, decode_range_coded<1>, true },
+	{ "delta_rc4", encode_range_coded<4>, decode_range_coded<4>, true },
+};
+
+// A plausible world: positions spread over a few thousand units,
+// most objects standing still, the rest moving slowly. Everything is
+// inside the NetQuantization<GameObject> ranges, so every encoding
+// round-trips exactly. The baselines are where each object was a
+// tick ago: one velocity step back.
+void make_objects(size_t count, BenchBuffers& b)
+{
+	std::mt19937 rng(430);
+	std::uniform_int_distribution<int> position(-4000, 4000);
+	std::uniform_int_distribution<int> velocity(-20, 20);
+	std::uniform_int_distribution<int> percent(0, 99);
+
+	b.objects.resize(count);
+	b.decoded.resize(count);
+	b.object_ptrs.resize(count);
+	b.decoded_ptrs.resize(count);
+	b.baselines.resize(count);
+	b.baseline_ptrs.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		GameObject& go = b.objects[i];
+		go.x = position(rng);
+		go.y = position(rng);
+		go.z = position(rng) / 16;
+		bool moving = percent(rng) < 30;
+		go.xVel = moving ? velocity(rng) : 0;
+		go.yVel = moving ? velocity(rng) : 0;
+		go.zVel = 0;
+		go.sprite = nullptr;
+		b.object_ptrs[i] = &b.objects[i];
+		b.decoded_ptrs[i] = &b.decoded[i];
+
+		GameObject& before = b.baselines[i];
+		before = go;
+		before.x -= go.xVel;
+		before.y -= go.yVel;
+		before.z -= go.zVel;
+		b.baseline_ptrs[i] = &before;
+	}
+	b.buffer.resize(count * kMaxObjectBytes + 64);
+	b.packed.resize(packed_payload_bound(b.buffer.size()));
+}
+
+bool same_objects(const BenchBuffers& b)
+{
+	for (size_t i = 0; i < b.objects.size(); i++) {
+		const GameObject& a = b.objects[i];
+		const GameObject& d = b.decoded[i];
+		if (a.x != d.x || a.y != d.y || a.z != d.z || a.xVel != d.xVel || a.yVel != d.yVel || a.zVel != d.zVel)
+			return false;
+	}
+	return true;
+}
+
+struct Measurement {
+	double ns;
+	double allocs;
+};
+
+// Runs fn reps times and returns the per-object cost.
+template <typename Fn>
+Measurement measure(size_t count, size_t reps, Fn&& fn)
+{
+	size_t allocs_before = get_allocation_stats().total_allocations;
+	bench_clock::time_point start = bench_clock::now();
+	for (size_t r = 0; r < reps; r++) fn();
+	bench_clock::time_point end = bench_clock::now();
+	size_t allocs = get_allocation_stats().total_allocations - allocs_before;
+
+	double objects = (double)count * reps;
+	double ns = std::chrono::duration<double, std::nano>(end - start).count();
+	return Measurement{ ns / objects, allocs / objects };
+}
+
+// measure(), under a zero budget for the encodings that shouldn't
+// allocate at all. The bench builds with ALLOCATION_BUDGET_THROWS, so
+// an allocation sneaking into one of them throws out of here, even
+// when something in between (a stringstream) swallowed the first
+// exception.
+template <typename Fn>
+Measurement measure_encoding(const Encoding& encoding, size_t count, size_t reps, Fn&& fn)
+{
+	if (!encoding.allocation_free) return measure(count, reps, fn);
+	ZeroAllocationScope scope(encoding.name);
+	Measurement m = measure(count, reps, fn);
+	if (scope.BudgetExceeded()) throw AllocationBudgetExceeded("allocation budget exceeded");
+	return m;
+}
+
+double gb_per_sec(double ns_per_object)
+{
+	double state_bytes = (double)net_size<GameObject>();
+	return ns_per_object > 0 ? state_bytes / ns_per_object : 0;
+}
+
+int main(int argc, char** argv)
+{
+	set_allocs_should_print(false);
+
+	FILE* out = stdout;
+	if (argc > 1) {
+		out = fopen(argv[1], "w");
+		if (out == nullptr) {
+			perror(argv[1]);
+			return 1;
+		}
+	}
+
+	const size_t counts[] = { 1, 1000, 1000000 };
+	bool first = true;
+	bool all_ok = true;
+
+	fprintf(out, "[\n");
+	for (size_t count : counts) {
+		BenchBuffers b;
+		make_objects(count, b);
+		size_t reps = count < kObjectsPerMeasurement ? kObjectsPerMeasurement / count : 1;
+
+		for (const Encoding& encoding : kEncodings) {
+			// Warm-up, and the round trip check.
+			size_t len = encoding.encode(b);
+			bool ok = len != 0 && encoding.decode(b, len) && same_objects(b);
+
+			Measurement enc = { 0, 0 };
+			Measurement dec = { 0, 0 };
+			try {
+				enc = measure_encoding(encoding, count, reps, [&] { len = encoding.encode(b); });
+				dec = measure_encoding(encoding, count, reps, [&] { ok = encoding.decode(b, len) && ok; });
+			} catch (const AllocationBudgetExceeded& e) {
+				fprintf(stderr, "%s, %zu objects: %s\n", encoding.name, count, e.what());
+				ok = false;
+			}
+			all_ok = all_ok && ok;
+
+			fprintf(out, "%s  {\"encoding\": \"%s\", \"objects\": %zu, \"ok\": %s, "
+				"\"bytes\": %.2f, \"encode_ns\": %.2f, \"decode_ns\": %.2f, "
+				"\"encode_allocs\": %.3f, \"decode_allocs\": %.3f, "
+				"\"encode_gbps\": %.3f, \"decode_gbps\": %.3f}",
+				first ? "" : ",\n", encoding.name, count, ok ? "true" : "false",
+				(double)len / count, enc.ns, dec.ns,
+				enc.allocs, dec.allocs,
+				gb_per_sec(enc.ns), gb_per_sec(dec.ns));
+			fflush(out);
+			first = false;
+		}
+	}
+	fprintf(out, "\n]\n");
+	if (out != stdout) fclose(out);
+
+	return all_ok ? 0 : 1;
+}
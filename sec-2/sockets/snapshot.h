@@ -0,0 +1,252 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+#include <algorithm>
+#include <vector>
+#include "bytestream.h"
+#include "net_fields.h"
+
+// Delta-compressed snapshots
+// ==========================
+// Rather than send every object in full every tick, the server sends
+// each client only what changed since a snapshot that client has
+// acknowledged (its baseline):
+//
+//   - objects identical to the baseline are skipped entirely,
+//   - changed objects carry a bitmask of changed fields (net_diff())
+//     followed by just those fields, compactly encoded,
+//   - objects that disappeared are listed by id.
+//
+// Both ends keep a SnapshotRing of recent snapshots. The server
+// records every snapshot it sends to a client; the client records
+// every snapshot it decodes and acks its sequence number. If the
+// acked snapshot has already fallen out of the server's ring (or
+// nothing was ever acked) there is no baseline and the server sends
+// full state, which the client can always decode.
+//
+// Wire format, all integers little-endian or varint:
+//
+//     uint32  sequence
+//     uint32  baseline sequence (kNoBaseline for full state)
+//     uint32  number of changed objects
+//       varint  id delta from the previous changed object
+//       varint  changed-field mask
+//       ...     the masked fields (net_write_compact())
+//     varint  number of removed objects
+//       varint  id delta from the previous removed object
+//
+// T must have a NetFields<T> declaration.
+
+const uint32_t kNoBaseline = 0xffffffff;
+
+template<typename T>
+struct SnapshotEntry
+{
+  uint32_t id;
+  T state;
+};
+
+// The state of every replicated object at one tick. Entries must be
+// sorted by ascending id; encoding walks current and baseline in step.
+template<typename T>
+struct Snapshot
+{
+  uint32_t sequence = kNoBaseline;
+  std::vector<SnapshotEntry<T>> entries;
+
+  void Clear(uint32_t new_sequence)
+  {
+    sequence = new_sequence;
+    entries.clear();
+  }
+
+  void Add(uint32_t id, const T& state)
+  {
+    assert(entries.empty() || entries.back().id < id);
+    entries.push_back(SnapshotEntry<T>{ id, state });
+  }
+};
+
+// The last N snapshots, indexed by sequence number. Slots are reused,
+// so once their vectors have grown to the object count, recording a
+// snapshot no longer allocates.
+template<typename T, size_t N = 32>
+class SnapshotRing
+{
+ public:
+  Snapshot<T>& Record(const Snapshot<T>& snapshot)
+  {
+    Snapshot<T>& slot = _slots[snapshot.sequence % N];
+    slot.sequence = snapshot.sequence;
+    slot.entries.assign(snapshot.entries.begin(), snapshot.entries.end());
+    return slot;
+  }
+
+  // Null if that sequence was never recorded or has been overwritten.
+  const Snapshot<T>* Find(uint32_t sequence) const
+  {
+    if (sequence == kNoBaseline) return nullptr;
+    const Snapshot<T>& slot = _slots[sequence % N];
+    return slot.sequence == sequence ? &slot : nullptr;
+  }
+
+ private:
+  Snapshot<T> _slots[N];
+};
+
+// Server-side view of one client: what was sent and what was acked.
+template<typename T, size_t N = 32>
+class ClientSnapshotHistory
+{
+ public:
+  void Sent(const Snapshot<T>& snapshot) { _sent.Record(snapshot); }
+
+  // Acks can arrive late or out of order; only move forward.
+  void Ack(uint32_t sequence)
+  {
+    if (_acked == kNoBaseline || (int32_t)(sequence - _acked) > 0)
+      _acked = sequence;
+  }
+
+  // The snapshot to delta against, or null to send full state.
+  const Snapshot<T>* Baseline() const { return _sent.Find(_acked); }
+
+  void Reset() { _acked = kNoBaseline; }
+
+ private:
+  SnapshotRing<T, N> _sent;
+  uint32_t _acked = kNoBaseline;
+};
+
+template<typename T>
+constexpr uint32_t snapshot_full_mask()
+{
+  return net_field_count<T>() >= 32 ? ~0u : (1u << net_field_count<T>()) - 1;
+}
+
+// Writes current relative to baseline (null for full state).
+template<typename T>
+bool write_snapshot_delta(OutByteStream& stream, const Snapshot<T>& current, const Snapshot<T>* baseline)
+{
+  stream.Insert(current.sequence);
+  stream.Insert(baseline ? baseline->sequence : kNoBaseline);
+
+  // Patched once the changed objects have been counted.
+  size_t count_offset = stream.size();
+  stream.Insert((uint32_t)0);
+
+  static const std::vector<SnapshotEntry<T>> kEmpty;
+  const std::vector<SnapshotEntry<T>>& base = baseline ? baseline->entries : kEmpty;
+  size_t b = 0;
+  uint32_t changed = 0;
+  uint32_t previous_id = 0;
+  for (const SnapshotEntry<T>& entry : current.entries)
+  {
+    while (b < base.size() && base[b].id < entry.id) b++;
+    uint32_t mask = snapshot_full_mask<T>();
+    if (b < base.size() && base[b].id == entry.id)
+    {
+      mask = net_diff(base[b].state, entry.state);
+      if (mask == 0) continue;
+    }
+    stream.InsertVarint(entry.id - previous_id);
+    stream.InsertVarint(mask);
+    net_write_compact(stream, entry.state, mask);
+    previous_id = entry.id;
+    changed++;
+  }
+  if (stream.ok()) store_le(stream.data() + count_offset, changed);
+
+  // Objects in the baseline that are gone now.
+  size_t removed = 0;
+  size_t c = 0;
+  for (const SnapshotEntry<T>& entry : base)
+  {
+    while (c < current.entries.size() && current.entries[c].id < entry.id) c++;
+    if (c == current.entries.size() || current.entries[c].id != entry.id) removed++;
+  }
+  stream.InsertVarint(removed);
+  c = 0;
+  previous_id = 0;
+  for (const SnapshotEntry<T>& entry : base)
+  {
+    while (c < current.entries.size() && current.entries[c].id < entry.id) c++;
+    if (c == current.entries.size() || current.entries[c].id != entry.id)
+    {
+      stream.InsertVarint(entry.id - previous_id);
+      previous_id = entry.id;
+    }
+  }
+  return stream.ok();
+}
+
+// Rebuilds the sender's snapshot into out, looking the baseline up in
+// `received`. Fails on malformed input or when the baseline isn't in
+// the ring; the caller should then keep acking its last good snapshot
+// (or nothing) until the server falls back to full state.
+template<typename T, size_t N>
+bool read_snapshot_delta(InByteStream& stream, const SnapshotRing<T, N>& received, Snapshot<T>& out)
+{
+  uint32_t sequence = 0;
+  uint32_t baseline_sequence = 0;
+  uint32_t changed = 0;
+  stream.Read(sequence);
+  stream.Read(baseline_sequence);
+  stream.Read(changed);
+  // Each changed object takes at least two bytes (id delta and mask),
+  // so a larger count is malformed -- don't reserve() for it.
+  if (!stream.ok() || changed > stream.bytes_remaining() / 2) return false;
+
+  const Snapshot<T>* baseline = received.Find(baseline_sequence);
+  if (baseline_sequence != kNoBaseline && baseline == nullptr) return false;
+
+  static const std::vector<SnapshotEntry<T>> kEmpty;
+  const std::vector<SnapshotEntry<T>>& base = baseline ? baseline->entries : kEmpty;
+
+  out.Clear(sequence);
+  out.entries.reserve(base.size() + changed);
+
+  // Merge: unchanged baseline entries are carried over as-is, changed
+  // ones start from the baseline state (or a default T) and take the
+  // masked fields from the stream.
+  size_t b = 0;
+  uint32_t id = 0;
+  for (uint32_t i = 0; i < changed && stream.ok(); i++)
+  {
+    uint32_t id_delta = 0;
+    uint32_t mask = 0;
+    stream.ReadVarint(id_delta);
+    stream.ReadVarint(mask);
+    if (i > 0 && id_delta == 0) return false;
+    id += id_delta;
+
+    while (b < base.size() && base[b].id < id) out.entries.push_back(base[b++]);
+    if (b < base.size() && base[b].id == id)
+      out.entries.push_back(base[b++]);
+    else
+      out.entries.push_back(SnapshotEntry<T>{ id, T() });
+    net_read_compact(stream, out.entries.back().state, mask);
+  }
+  while (b < base.size()) out.entries.push_back(base[b++]);
+
+  uint32_t removed = 0;
+  stream.ReadVarint(removed);
+  id = 0;
+  size_t keep = 0;
+  size_t next = 0;
+  for (uint32_t i = 0; i < removed && stream.ok(); i++)
+  {
+    uint32_t id_delta = 0;
+    stream.ReadVarint(id_delta);
+    if (i > 0 && id_delta == 0) return false;
+    id += id_delta;
+    while (next < out.entries.size() && out.entries[next].id < id) out.entries[keep++] = out.entries[next++];
+    if (next < out.entries.size() && out.entries[next].id == id) next++;
+  }
+  while (next < out.entries.size()) out.entries[keep++] = out.entries[next++];
+  out.entries.erase(out.entries.begin() + keep, out.entries.end());
+
+  return stream.ok();
+}
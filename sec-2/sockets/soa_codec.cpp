@@ -0,0 +1,210 @@
+#include "soa_codec.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SOA_HAVE_SSE2 1
+#endif
+
+static const int kNumPlanes = 4;
+
+static inline uint32_t zigzag32(int32_t value)
+{
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t unzigzag32(uint32_t value)
+{
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static inline int32_t delta32(int32_t value, int32_t previous)
+{
+  return (int32_t)((uint32_t)value - (uint32_t)previous);
+}
+
+// Malformed input: skipping past the end puts the stream into its
+// sticky failed state, like any other short read.
+static void fail_stream(InByteStream& stream)
+{
+  stream.Skip(SIZE_MAX);
+}
+
+#if defined(SOA_HAVE_SSE2)
+static inline __m128i zigzag_delta(__m128i values, __m128i previous)
+{
+  __m128i delta = _mm_sub_epi32(values, previous);
+  return _mm_xor_si128(_mm_slli_epi32(delta, 1), _mm_srai_epi32(delta, 31));
+}
+
+// Interleaves the bytes of (r0 r1) with those of (r2 r3). Viewing the
+// four registers as one 64-byte array, byte position p moves to p
+// rotated left by one bit. Four of these turn 16 uint32s (position
+// = value * 4 + byte) into 4 byte planes (byte * 16 + value); two more
+// turn them back.
+static inline void interleave_bytes(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3)
+{
+  __m128i a = _mm_unpacklo_epi8(r0, r2);
+  __m128i b = _mm_unpackhi_epi8(r0, r2);
+  __m128i c = _mm_unpacklo_epi8(r1, r3);
+  __m128i d = _mm_unpackhi_epi8(r1, r3);
+  r0 = a;
+  r1 = b;
+  r2 = c;
+  r3 = d;
+}
+#endif
+
+// OR of every zigzagged delta: byte plane i is needed iff byte i of
+// the result is non-zero.
+static uint32_t column_plane_bits(const int32_t* values, size_t count)
+{
+  if (count == 0) return 0;
+  uint32_t bits = zigzag32(values[0]);
+  size_t i = 1;
+#if defined(SOA_HAVE_SSE2)
+  __m128i acc = _mm_setzero_si128();
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128i current = _mm_loadu_si128((const __m128i*)(values + i));
+    __m128i previous = _mm_loadu_si128((const __m128i*)(values + i - 1));
+    acc = _mm_or_si128(acc, zigzag_delta(current, previous));
+  }
+  acc = _mm_or_si128(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+  acc = _mm_or_si128(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+  bits |= (uint32_t)_mm_cvtsi128_si32(acc);
+#endif
+  for (; i < count; i++)
+    bits |= zigzag32(delta32(values[i], values[i - 1]));
+  return bits;
+}
+
+bool write_int32_column(OutByteStream& stream, const int32_t* values, size_t count)
+{
+  uint32_t bits = column_plane_bits(values, count);
+  uint8_t mask = 0;
+  int num_planes = 0;
+  for (int p = 0; p < kNumPlanes; p++)
+  {
+    if ((bits >> (8 * p)) & 0xff)
+    {
+      mask |= (uint8_t)(1 << p);
+      num_planes++;
+    }
+  }
+
+  if (!stream.Insert(mask)) return false;
+  char* out = stream.Reserve(num_planes * count);
+  if (out == nullptr) return false;
+
+  // Null for dropped planes.
+  uint8_t* planes[kNumPlanes] = {};
+  for (int p = 0; p < kNumPlanes; p++)
+  {
+    if (mask & (1 << p))
+    {
+      planes[p] = (uint8_t*)out;
+      out += count;
+    }
+  }
+
+  size_t i = 0;
+#if defined(SOA_HAVE_SSE2)
+  for (; i + 16 <= count; i += 16)
+  {
+    const int32_t* v = values + i;
+    __m128i first = _mm_loadu_si128((const __m128i*)v);
+    // The value before the column is 0.
+    __m128i first_previous = i == 0 ? _mm_slli_si128(first, 4)
+                                    : _mm_loadu_si128((const __m128i*)(v - 1));
+    __m128i r0 = zigzag_delta(first, first_previous);
+    __m128i r1 = zigzag_delta(_mm_loadu_si128((const __m128i*)(v + 4)), _mm_loadu_si128((const __m128i*)(v + 3)));
+    __m128i r2 = zigzag_delta(_mm_loadu_si128((const __m128i*)(v + 8)), _mm_loadu_si128((const __m128i*)(v + 7)));
+    __m128i r3 = zigzag_delta(_mm_loadu_si128((const __m128i*)(v + 12)), _mm_loadu_si128((const __m128i*)(v + 11)));
+    interleave_bytes(r0, r1, r2, r3);
+    interleave_bytes(r0, r1, r2, r3);
+    interleave_bytes(r0, r1, r2, r3);
+    interleave_bytes(r0, r1, r2, r3);
+    if (planes[0]) _mm_storeu_si128((__m128i*)(planes[0] + i), r0);
+    if (planes[1]) _mm_storeu_si128((__m128i*)(planes[1] + i), r1);
+    if (planes[2]) _mm_storeu_si128((__m128i*)(planes[2] + i), r2);
+    if (planes[3]) _mm_storeu_si128((__m128i*)(planes[3] + i), r3);
+  }
+#endif
+  for (; i < count; i++)
+  {
+    uint32_t z = zigzag32(delta32(values[i], i == 0 ? 0 : values[i - 1]));
+    for (int p = 0; p < kNumPlanes; p++)
+      if (planes[p]) planes[p][i] = (uint8_t)(z >> (8 * p));
+  }
+  return true;
+}
+
+bool read_int32_column(InByteStream& stream, int32_t* out, size_t count)
+{
+  uint8_t mask = 0;
+  if (!stream.Read(mask)) return false;
+  if (mask >> kNumPlanes)
+  {
+    fail_stream(stream);
+    return false;
+  }
+
+  int num_planes = 0;
+  for (int p = 0; p < kNumPlanes; p++)
+    if (mask & (1 << p)) num_planes++;
+  size_t len = count > SIZE_MAX / kNumPlanes ? SIZE_MAX : num_planes * count;
+  ByteSpan in = stream.ReadSpan(len);
+  if (!stream.ok()) return false;
+
+  const uint8_t* planes[kNumPlanes] = {};
+  const uint8_t* next = (const uint8_t*)in.data;
+  for (int p = 0; p < kNumPlanes; p++)
+  {
+    if (mask & (1 << p))
+    {
+      planes[p] = next;
+      next += count;
+    }
+  }
+
+  size_t i = 0;
+  int32_t previous = 0;
+#if defined(SOA_HAVE_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi32(1);
+  __m128i running = zero;
+  for (; i + 16 <= count; i += 16)
+  {
+    __m128i r0 = planes[0] ? _mm_loadu_si128((const __m128i*)(planes[0] + i)) : zero;
+    __m128i r1 = planes[1] ? _mm_loadu_si128((const __m128i*)(planes[1] + i)) : zero;
+    __m128i r2 = planes[2] ? _mm_loadu_si128((const __m128i*)(planes[2] + i)) : zero;
+    __m128i r3 = planes[3] ? _mm_loadu_si128((const __m128i*)(planes[3] + i)) : zero;
+    interleave_bytes(r0, r1, r2, r3);
+    interleave_bytes(r0, r1, r2, r3);
+
+    __m128i* dst = (__m128i*)(out + i);
+    __m128i zigzagged[4] = { r0, r1, r2, r3 };
+    for (int k = 0; k < 4; k++)
+    {
+      __m128i z = zigzagged[k];
+      __m128i d = _mm_xor_si128(_mm_srli_epi32(z, 1), _mm_sub_epi32(zero, _mm_and_si128(z, one)));
+      // Prefix sum of the four deltas, on top of the last value.
+      d = _mm_add_epi32(d, _mm_slli_si128(d, 4));
+      d = _mm_add_epi32(d, _mm_slli_si128(d, 8));
+      d = _mm_add_epi32(d, running);
+      _mm_storeu_si128(dst + k, d);
+      running = _mm_shuffle_epi32(d, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+  }
+  previous = _mm_cvtsi128_si32(running);
+#endif
+  for (; i < count; i++)
+  {
+    uint32_t z = 0;
+    for (int p = 0; p < kNumPlanes; p++)
+      if (planes[p]) z |= (uint32_t)planes[p][i] << (8 * p);
+    previous = (int32_t)((uint32_t)previous + (uint32_t)unzigzag32(z));
+    out[i] = previous;
+  }
+  return true;
+}
@@ -1,12 +1,19 @@
 #pragma once
 
 #include <memory>
+#include <memory_resource>
 #include <string>
 #include <vector>
 #include <iostream>
 #include "pool.h"
+#include "bytestring.h"
 
-typedef std::vector<char> ByteString;
+// Most of our messages are well under 128 bytes, so those never
+// touch the heap.
+typedef SmallByteString<128> ByteString;
+// Same as ByteString, but allocating from a caller-provided
+// std::pmr::memory_resource (see memory_resources.h).
+typedef std::pmr::vector<char> PmrByteString;
 
 class Address
 {
@@ -35,6 +42,9 @@ class Socket
     DGRAM
   };
 
+  // Most datagrams SendToBatch()/RecvFromBatch() move per system call.
+  static const int kMaxBatch = 64;
+
   enum Error {
     SOCKLIB_ETIMEDOUT,
     SOCKLIB_EWOULDBLOCK
@@ -59,12 +69,28 @@ class Socket
   int Connect(const Address& address);
   PoolView RecvIntoPool(unsigned int max_len);
   int Recv(char* buffer, int size);
+  // Receive up to buffer.size() bytes into buffer. Use
+  // resize_uninitialized() to size a ByteString for this.
   int Recv(ByteString& buffer);
+  int Recv(std::vector<char>& buffer);
+  int Recv(PmrByteString& buffer);
   int RecvFrom(char* buffer, int size, Address& src);
   size_t Send(const char* data, size_t len);
   size_t SendTo(const char* buffer, size_t len, const Address& dest);
+  // Sends each of packets[0..count) to dest as its own datagram, in
+  // as few system calls as the platform allows (one sendmmsg() per
+  // kMaxBatch on Linux). Returns the number sent.
+  int SendToBatch(const ByteSpan* packets, int count, const Address& dest);
+  // Receives up to count datagrams, datagram i into
+  // buffer + i * packet_size, with its length in sizes[i] and sender
+  // in srcs[i]. Waits (blocking mode and timeout permitting) for the
+  // first one only, then takes whatever else has already arrived.
+  // Returns the number received, or -1 like RecvFrom().
+  int RecvFromBatch(char* buffer, int packet_size, int count, int* sizes, Address* srcs);
   size_t SendAll(const char* data, size_t len);
   size_t SendAll(const ByteString& data);
+  size_t SendAll(const PmrByteString& data);
+  size_t SendAll(ByteSpan data);
 
   static void native_destroy(Socket& socket);
 
@@ -81,5 +107,13 @@ void SockLibInit();
 void SockLibShutdown();
 
 ByteString to_bytestring(const char* msg, size_t len);
+PmrByteString to_bytestring(const char* msg, size_t len, std::pmr::memory_resource* resource);
+std::string to_string(const ByteString& s);
+std::pmr::string to_string(const char* msg, size_t len, std::pmr::memory_resource* resource);
 std::ostream& operator<<(std::ostream& s, const ByteString& b);
+std::ostream& operator<<(std::ostream& s, const PmrByteString& b);
 std::ostream& operator<<(std::ostream& s, const Address& a);
+// Same host and port. (Address bytes can't be compared directly; the
+// padding isn't always zeroed.)
+bool operator==(const Address& a, const Address& b);
+inline bool operator!=(const Address& a, const Address& b) { return !(a == b); }
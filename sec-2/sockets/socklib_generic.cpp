@@ -7,6 +7,11 @@ std::string to_string(const ByteString &s) {
   return str;
 }
 
+std::pmr::string to_string(const char *msg, size_t len,
+                           std::pmr::memory_resource *resource) {
+  return std::pmr::string(msg, len, resource);
+}
+
 Socket::Socket() {
   memset(_data.data, 0, sizeof(_data.data));
   _has_socket = false;
@@ -38,6 +43,14 @@ size_t Socket::SendAll(const ByteString &data) {
     return SendAll(data.data(), data.size());
 }
 
+size_t Socket::SendAll(const PmrByteString &data) {
+    return SendAll(data.data(), data.size());
+}
+
+size_t Socket::SendAll(ByteSpan data) {
+    return SendAll(data.data, data.size);
+}
+
 size_t Socket::SendAll(const char *data, size_t len) {
   size_t send_count = 0;
   while (send_count < len) {
@@ -52,25 +65,40 @@ int Socket::Recv(ByteString &buffer) {
     return Recv(buffer.data(), buffer.size());
 }
 
+int Socket::Recv(std::vector<char> &buffer) {
+    return Recv(buffer.data(), buffer.size());
+}
+
+int Socket::Recv(PmrByteString &buffer) {
+    return Recv(buffer.data(), buffer.size());
+}
+
 PoolView Socket::RecvIntoPool(unsigned int max_len) {
   PoolView pool = get_pool(max_len);
   pool.name = "Recv Temp Pool";
 
-  Recv(*pool);
+  pool->resize(max_len);
+  int count = Recv(*pool);
+  pool->resize(count > 0 ? count : 0);
 
   return pool;
 }
 
 ByteString to_bytestring(const char *msg, size_t len) {
-  ByteString str;
-  str.reserve(len);
-  for (const char *p = msg; *p != '\0'; p++) {
-    str.push_back(*p);
-  }
-  return str;
+  return ByteString(msg, len);
+}
+
+PmrByteString to_bytestring(const char *msg, size_t len,
+                            std::pmr::memory_resource *resource) {
+  return PmrByteString(msg, msg + len, resource);
 }
 
 std::ostream &operator<<(std::ostream &s, const ByteString &b) {
   s.write(b.data(), b.size());
   return s;
 }
+
+std::ostream &operator<<(std::ostream &s, const PmrByteString &b) {
+  s.write(b.data(), b.size());
+  return s;
+}
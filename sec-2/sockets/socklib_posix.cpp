@@ -241,6 +241,105 @@ size_t Socket::SendTo(const char* data, size_t len, const Address& dst) {
   return count;
 }
 
+#if defined(__linux__)
+int Socket::SendToBatch(const ByteSpan* packets, int count, const Address& dst) {
+  sockaddr_in native_addr = to_native_address(dst);
+  mmsghdr messages[kMaxBatch];
+  iovec iovecs[kMaxBatch];
+  int sent = 0;
+  while (sent < count) {
+    int batch = count - sent < kMaxBatch ? count - sent : kMaxBatch;
+    memset(messages, 0, sizeof(mmsghdr) * batch);
+    for (int i = 0; i < batch; i++) {
+      iovecs[i].iov_base = (void*)packets[sent + i].data;
+      iovecs[i].iov_len = packets[sent + i].size;
+      messages[i].msg_hdr.msg_name = &native_addr;
+      messages[i].msg_hdr.msg_namelen = sizeof(native_addr);
+      messages[i].msg_hdr.msg_iov = &iovecs[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    int count_sent = sendmmsg(to_native_socket(*this), messages, batch, 0);
+    if (count_sent == -1) {
+      throw std::runtime_error(std::string("sendmmsg(): ") + strerror(errno));
+    }
+    sent += count_sent;
+  }
+  return sent;
+}
+
+int Socket::RecvFromBatch(char* buffer, int packet_size, int count, int* sizes, Address* srcs) {
+  if (count > kMaxBatch) count = kMaxBatch;
+  mmsghdr messages[kMaxBatch];
+  iovec iovecs[kMaxBatch];
+  PosixAddress native_addrs[kMaxBatch];
+  memset(messages, 0, sizeof(mmsghdr) * count);
+  for (int i = 0; i < count; i++) {
+    iovecs[i].iov_base = buffer + (size_t)i * packet_size;
+    iovecs[i].iov_len = packet_size;
+    messages[i].msg_hdr.msg_name = &native_addrs[i].address;
+    messages[i].msg_hdr.msg_namelen = sizeof(native_addrs[i].address);
+    messages[i].msg_hdr.msg_iov = &iovecs[i];
+    messages[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int received = recvmmsg(to_native_socket(*this), messages, count, MSG_WAITFORONE, nullptr);
+  if (received == -1) {
+    if (errno == EAGAIN) {
+      _last_error = SOCKLIB_ETIMEDOUT;
+      return -1;
+    }
+    throw std::runtime_error(std::string("recvmmsg(): ") + strerror(errno));
+  }
+
+  for (int i = 0; i < received; i++) {
+    sizes[i] = (int)messages[i].msg_len;
+    srcs[i]._data = native_addrs[i].generic_data;
+  }
+  return received;
+}
+#else
+// No sendmmsg()/recvmmsg() (macOS, the BSDs): one call per datagram.
+int Socket::SendToBatch(const ByteSpan* packets, int count, const Address& dst) {
+  for (int i = 0; i < count; i++)
+    SendTo(packets[i].data, packets[i].size, dst);
+  return count;
+}
+
+int Socket::RecvFromBatch(char* buffer, int packet_size, int count, int* sizes, Address* srcs) {
+  if (count > kMaxBatch) count = kMaxBatch;
+  int received = 0;
+  while (received < count) {
+    PosixAddress native_addr;
+    socklen_t socklen = sizeof(native_addr.address);
+    // Only the first receive waits.
+    ssize_t len = recvfrom(to_native_socket(*this), buffer + (size_t)received * packet_size, packet_size,
+                           received == 0 ? 0 : MSG_DONTWAIT, (sockaddr*)&native_addr.address, &socklen);
+    if (len == -1) {
+      if (errno != EAGAIN) {
+        throw std::runtime_error(std::string("recvfrom(): ") + strerror(errno));
+      }
+      if (received == 0) {
+        _last_error = SOCKLIB_ETIMEDOUT;
+        return -1;
+      }
+      break;
+    }
+    sizes[received] = (int)len;
+    srcs[received]._data = native_addr.generic_data;
+    received++;
+  }
+  return received;
+}
+#endif
+
+bool operator==(const Address& a, const Address& b) {
+  sockaddr_in native_a = to_native_address(a);
+  sockaddr_in native_b = to_native_address(b);
+  return native_a.sin_family == native_b.sin_family &&
+         native_a.sin_port == native_b.sin_port &&
+         native_a.sin_addr.s_addr == native_b.sin_addr.s_addr;
+}
+
 std::ostream& operator<<(std::ostream& s, const Address& a) {
   sockaddr_in nat_addr = to_native_address(a);
   s << inet_ntoa(nat_addr.sin_addr);
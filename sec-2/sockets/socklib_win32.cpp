@@ -230,6 +230,40 @@ size_t Socket::SendTo(const char* data, size_t len, const Address& dst) {
   return count;
 }
 
+// Winsock has no sendmmsg()/recvmmsg(): one call per datagram.
+int Socket::SendToBatch(const ByteSpan* packets, int count, const Address& dst) {
+  for (int i = 0; i < count; i++)
+    SendTo(packets[i].data, packets[i].size, dst);
+  return count;
+}
+
+int Socket::RecvFromBatch(char* buffer, int packet_size, int count, int* sizes, Address* srcs) {
+  if (count > kMaxBatch) count = kMaxBatch;
+  int received = 0;
+  while (received < count) {
+    // Only the first receive waits; after that, stop once nothing is
+    // queued.
+    if (received > 0) {
+      u_long available = 0;
+      require(ioctlsocket(to_native_socket(*this), FIONREAD, &available) != SOCKET_ERROR, "ioctlsocket()");
+      if (available == 0) break;
+    }
+    int len = RecvFrom(buffer + (size_t)received * packet_size, packet_size, srcs[received]);
+    if (len == -1) return received == 0 ? -1 : received;
+    sizes[received] = len;
+    received++;
+  }
+  return received;
+}
+
+bool operator==(const Address& a, const Address& b) {
+  SOCKADDR_IN native_a = to_native_address(a);
+  SOCKADDR_IN native_b = to_native_address(b);
+  return native_a.sin_family == native_b.sin_family &&
+         native_a.sin_port == native_b.sin_port &&
+         native_a.sin_addr.s_addr == native_b.sin_addr.s_addr;
+}
+
 std::ostream& operator<<(std::ostream& s, const Address& a) {
   SOCKADDR_IN nat_addr = to_native_address(a);
   s << inet_ntoa(nat_addr.sin_addr);
@@ -0,0 +1,158 @@
+#include "udp_client.h"
+#include <charconv>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+typedef std::chrono::steady_clock udp_clock;
+
+// "<id> <character>" fits with room to spare.
+static const size_t kRequestSlot = 16;
+// One byte over the largest reply, so a reply that was cut short can
+// be told apart from one that fits exactly.
+static const int kReplySlot = kUdpClientMaxReply + 1;
+
+UDPClient::UDPClient(const char* host, int port, bool include_ids)
+  : _socket(Socket::Family::INET, Socket::Type::DGRAM),
+    _server(host, port),
+    _include_ids(include_ids),
+    _next_id(0)
+{
+  _socket.SetTimeout(kUdpClientTimeoutSeconds);
+}
+
+int UDPClient::send_message_by_character(const std::string& str, std::string& result)
+{
+  result.clear();
+  if (str.empty()) return 0;
+  return _include_ids ? SendTagged(str, result) : SendOneAtATime(str, result);
+}
+
+int UDPClient::SendTagged(const std::string& str, std::string& result)
+{
+  size_t count = str.size();
+  // IDs carry on from the last message, so its late replies can't be
+  // taken for this one's.
+  uint32_t base = _next_id;
+  _next_id += (uint32_t)count;
+
+  std::vector<std::string> replies(count);
+  std::vector<bool> received(count, false);
+  size_t remaining = count;
+
+  // Characters waiting to be sent, first time or again. Only the
+  // tail past `next` is still to go.
+  std::vector<size_t> queue(count);
+  for (size_t i = 0; i < count; i++) queue[i] = i;
+  size_t next = 0;
+  std::vector<int> sends(count, 0);
+  std::vector<bool> in_flight(count, false);
+  size_t num_in_flight = 0;
+  // Requests in the order they went out, so the oldest times out
+  // first.
+  struct SentRequest
+  {
+    size_t index;
+    udp_clock::time_point at;
+  };
+  std::deque<SentRequest> sent;
+
+  std::vector<char> requests(kUdpClientWindow * kRequestSlot);
+  std::vector<ByteSpan> packets;
+  std::vector<char> reply_buffer((size_t)Socket::kMaxBatch * kReplySlot);
+  int sizes[Socket::kMaxBatch];
+  Address srcs[Socket::kMaxBatch];
+  udp_clock::duration timeout =
+    std::chrono::duration_cast<udp_clock::duration>(std::chrono::duration<float>(kUdpClientTimeoutSeconds));
+
+  // A sliding window: each reply makes room for the next request, so
+  // a message of any length is all in flight after about one round
+  // trip. Timeouts go by our clock, not the socket's (a steady
+  // trickle of stray datagrams would keep resetting that), and each
+  // request has its own, so a lost one is sent again while the rest
+  // keep flowing.
+  while (remaining > 0) {
+    udp_clock::time_point now = udp_clock::now();
+    while (!sent.empty() && now - sent.front().at >= timeout) {
+      size_t index = sent.front().index;
+      sent.pop_front();
+      if (!in_flight[index]) continue;
+      if (sends[index] >= kUdpClientMaxAttempts) return -1;
+      in_flight[index] = false;
+      num_in_flight--;
+      queue.push_back(index);
+    }
+
+    packets.clear();
+    while (next < queue.size() && num_in_flight + packets.size() < (size_t)kUdpClientWindow) {
+      size_t index = queue[next++];
+      // Answered meanwhile, by a late reply to an earlier send.
+      if (received[index]) continue;
+      char* slot = requests.data() + packets.size() * kRequestSlot;
+      char* p = std::to_chars(slot, slot + kRequestSlot - 2, base + (uint32_t)index).ptr;
+      *p++ = ' ';
+      *p++ = str[index];
+      packets.push_back(ByteSpan{ slot, (size_t)(p - slot) });
+      sends[index]++;
+      in_flight[index] = true;
+      sent.push_back(SentRequest{ index, now });
+    }
+    if (!packets.empty()) {
+      _socket.SendToBatch(packets.data(), (int)packets.size(), _server);
+      num_in_flight += packets.size();
+    }
+
+    int got = _socket.RecvFromBatch(reply_buffer.data(), kReplySlot, Socket::kMaxBatch, sizes, srcs);
+    for (int r = 0; r < got; r++) {
+      if (srcs[r] != _server || sizes[r] > kUdpClientMaxReply) continue;
+      const char* reply = reply_buffer.data() + (size_t)r * kReplySlot;
+      const char* reply_end = reply + sizes[r];
+      uint32_t id = 0;
+      std::from_chars_result parsed = std::from_chars(reply, reply_end, id);
+      if (parsed.ec != std::errc() || parsed.ptr == reply_end || *parsed.ptr != ' ') continue;
+      // Unsigned, so IDs from before base wrap round to huge.
+      size_t index = id - base;
+      if (index >= count || received[index]) continue;
+
+      replies[index].assign(parsed.ptr + 1, reply_end);
+      received[index] = true;
+      remaining--;
+      if (in_flight[index]) {
+        in_flight[index] = false;
+        num_in_flight--;
+      }
+    }
+  }
+
+  for (const std::string& reply : replies) result += reply;
+  return 0;
+}
+
+int UDPClient::SendOneAtATime(const std::string& str, std::string& result)
+{
+  char reply[kReplySlot];
+  for (char c : str) {
+    bool answered = false;
+    for (int attempt = 0; attempt < kUdpClientMaxAttempts && !answered; attempt++) {
+      _socket.SendTo(&c, 1, _server);
+      udp_clock::time_point deadline = udp_clock::now() +
+        std::chrono::duration_cast<udp_clock::duration>(std::chrono::duration<float>(kUdpClientTimeoutSeconds));
+      while (udp_clock::now() < deadline) {
+        Address src;
+        int len = _socket.RecvFrom(reply, kReplySlot, src);
+        if (len < 0) break;
+        if (src != _server || len > kUdpClientMaxReply) continue;
+        // A late reply to the previous character's resend would be
+        // taken for this one's; only IDs can rule that out.
+        result.append(reply, len);
+        answered = true;
+        break;
+      }
+    }
+    if (!answered) {
+      result.clear();
+      return -1;
+    }
+  }
+  return 0;
+}
@@ -2,18 +2,49 @@
 
 #include "constants.h"
 #include "socklib.h"
-#include <sstream>
+#include <stdint.h>
+#include <string>
+
+// Character-at-a-time UDP client
+// ==============================
+// Sends a message to the server one character per datagram and
+// collects the replies, in order, into one string.
+//
+// Replies to a burst of datagrams come back in any order, some never
+// come back, and anyone can send us a datagram. So, with include_ids,
+// every character is tagged with an ID:
+//
+//     "<id> <character>"   request
+//     "<id> <reply>"       reply
+//
+// and the message goes out in bursts (sendmmsg() where there is one)
+// of up to kUdpClientWindow requests in flight, each reply making
+// room for another. Replies are only accepted from the server's
+// address, land in a reorder buffer by ID, and duplicates or replies
+// to an earlier message (IDs keep counting up across messages) are
+// dropped. After a timeout, only the IDs still missing are sent
+// again. A message then costs about one round trip, not one per
+// character or per window.
+//
+// Without IDs a reply can't be matched to its request, so characters
+// go one at a time, each waiting for its reply (or a timeout, then a
+// resend).
 
 class UDPClient {
 public:
-  UDPClient(const char* host, int port, bool include_ids = false)
-  {
-    /* TODO: IMPLEMENT THIS */
-  }
+  UDPClient(const char* host, int port, bool include_ids = false);
+
+  // Sends str and sets result to the replies, concatenated in order.
+  // Returns 0, or -1 if some character was sent kUdpClientMaxAttempts
+  // times without a reply (result is then left empty).
+  int send_message_by_character(const std::string& str, std::string& result);
+
+private:
+  int SendTagged(const std::string& str, std::string& result);
+  int SendOneAtATime(const std::string& str, std::string& result);
 
-  int send_message_by_character(const std::string& str, std::string& result)
-  {
-    /* TODO: IMPLEMENT THIS */
-    return -1;
-  }
+  Socket _socket;
+  Address _server;
+  bool _include_ids;
+  uint32_t _next_id;
 };
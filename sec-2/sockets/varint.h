@@ -0,0 +1,159 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "wire_endian.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VARINT_HAVE_SSE2 1
+#endif
+
+// Variable-length integers
+// ========================
+// LEB128: seven bits per byte, least significant group first, with the
+// high bit set on every byte except the last. Values under 128 take a
+// single byte, under 16384 two bytes, and so on up to 10 bytes for a
+// full uint64_t.
+//
+// Signed values go through zigzag first (0, -1, 1, -2, 2... map to
+// 0, 1, 2, 3, 4...) so small negative numbers stay small too.
+
+const size_t kMaxVarintBytes = 10;
+
+inline uint64_t zigzag_encode(int64_t value)
+{
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+inline int64_t zigzag_decode(uint64_t value)
+{
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+inline size_t varint_size(uint64_t value)
+{
+  size_t size = 1;
+  while (value >= 0x80)
+  {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+// Writes value to out, which must have room for varint_size(value)
+// bytes. Returns the number of bytes written.
+inline size_t varint_encode(uint64_t value, char* out)
+{
+  uint8_t* p = (uint8_t*)out;
+  if (value < 0x80)
+  {
+    p[0] = (uint8_t)value;
+    return 1;
+  }
+  if (value < 0x4000)
+  {
+    p[0] = (uint8_t)(value | 0x80);
+    p[1] = (uint8_t)(value >> 7);
+    return 2;
+  }
+  size_t i = 0;
+  while (value >= 0x80)
+  {
+    p[i++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  p[i++] = (uint8_t)value;
+  return i;
+}
+
+// Reads one varint from at most `avail` bytes. Returns the number of
+// bytes consumed, or 0 if the input is truncated or over-long.
+inline size_t varint_decode(const char* in, size_t avail, uint64_t* out)
+{
+  const uint8_t* p = (const uint8_t*)in;
+
+  // The common cases, unrolled: small values and small deltas.
+  if (avail >= 1 && p[0] < 0x80)
+  {
+    *out = p[0];
+    return 1;
+  }
+  if (avail >= 2 && p[1] < 0x80)
+  {
+    *out = (uint64_t)(p[0] & 0x7f) | ((uint64_t)p[1] << 7);
+    return 2;
+  }
+
+  uint64_t value = 0;
+  size_t limit = avail < kMaxVarintBytes ? avail : kMaxVarintBytes;
+  for (size_t i = 0; i < limit; i++)
+  {
+    // The tenth byte only has bit 63 left to carry; anything more
+    // would overflow.
+    if (i == kMaxVarintBytes - 1 && p[i] > 1) return 0;
+    value |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+    if (p[i] < 0x80)
+    {
+      *out = value;
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+// Decodes `count` varints into out. Returns the bytes consumed, or 0
+// on truncated/malformed input, including any value over 32 bits.
+//
+// Runs of single-byte values -- by far the most common case for small
+// or delta-coded fields -- are detected 16 (SSE2) or 8 (SWAR) bytes at
+// a time and widened without any per-byte branching.
+inline size_t varint_decode_array(const char* in, size_t avail, uint32_t* out, size_t count)
+{
+  const uint8_t* p = (const uint8_t*)in;
+  size_t pos = 0;
+  size_t i = 0;
+  while (i < count)
+  {
+#if defined(VARINT_HAVE_SSE2)
+    if (count - i >= 16 && avail - pos >= 16)
+    {
+      __m128i bytes = _mm_loadu_si128((const __m128i*)(p + pos));
+      if (_mm_movemask_epi8(bytes) == 0)
+      {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128((__m128i*)(out + i + 4), _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128((__m128i*)(out + i + 8), _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128((__m128i*)(out + i + 12), _mm_unpackhi_epi16(hi, zero));
+        i += 16;
+        pos += 16;
+        continue;
+      }
+    }
+#endif
+    if (count - i >= 8 && avail - pos >= 8)
+    {
+      uint64_t word = load_le<uint64_t>((const char*)p + pos);
+      if ((word & 0x8080808080808080ull) == 0)
+      {
+        for (int b = 0; b < 8; b++)
+          out[i + b] = (uint32_t)(word >> (8 * b)) & 0xff;
+        i += 8;
+        pos += 8;
+        continue;
+      }
+    }
+
+    uint64_t value;
+    size_t used = varint_decode((const char*)p + pos, avail - pos, &value);
+    if (used == 0 || value > UINT32_MAX) return 0;
+    out[i++] = (uint32_t)value;
+    pos += used;
+  }
+  return pos;
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#endif
+
+// Wire byte order
+// ===============
+// Everything we put on the wire is little-endian. On little-endian
+// hosts (x86, ARM in practice) the helpers below are plain loads and
+// stores; on big-endian hosts they add a byte swap.
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr bool kHostIsBigEndian = true;
+#else
+constexpr bool kHostIsBigEndian = false;
+#endif
+
+inline uint16_t bswap16(uint16_t x)
+{
+#if defined(_MSC_VER)
+  return _byteswap_ushort(x);
+#else
+  return __builtin_bswap16(x);
+#endif
+}
+
+inline uint32_t bswap32(uint32_t x)
+{
+#if defined(_MSC_VER)
+  return _byteswap_ulong(x);
+#else
+  return __builtin_bswap32(x);
+#endif
+}
+
+inline uint64_t bswap64(uint64_t x)
+{
+#if defined(_MSC_VER)
+  return _byteswap_uint64(x);
+#else
+  return __builtin_bswap64(x);
+#endif
+}
+
+// The unsigned integer with the same size as T, used to swap floats
+// and enums by their bits.
+template<size_t Size> struct WireBits;
+template<> struct WireBits<1> { typedef uint8_t type; };
+template<> struct WireBits<2> { typedef uint16_t type; };
+template<> struct WireBits<4> { typedef uint32_t type; };
+template<> struct WireBits<8> { typedef uint64_t type; };
+
+inline uint8_t bswap(uint8_t x) { return x; }
+inline uint16_t bswap(uint16_t x) { return bswap16(x); }
+inline uint32_t bswap(uint32_t x) { return bswap32(x); }
+inline uint64_t bswap(uint64_t x) { return bswap64(x); }
+
+// Writes value to out as little-endian. out needn't be aligned.
+template<typename T>
+inline void store_le(char* out, T value)
+{
+  static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "store_le() takes fixed-width values");
+  typedef typename WireBits<sizeof(T)>::type Bits;
+  Bits bits;
+  memcpy(&bits, &value, sizeof(T));
+  if (kHostIsBigEndian) bits = bswap(bits);
+  memcpy(out, &bits, sizeof(T));
+}
+
+template<typename T>
+inline T load_le(const char* in)
+{
+  static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "load_le() takes fixed-width values");
+  typedef typename WireBits<sizeof(T)>::type Bits;
+  Bits bits;
+  memcpy(&bits, in, sizeof(T));
+  if (kHostIsBigEndian) bits = bswap(bits);
+  T value;
+  memcpy(&value, &bits, sizeof(T));
+  return value;
+}
+
+// Bulk byte swaps
+// ===============
+// Reverse the bytes of every element of an array. dst and src may be
+// the same array. These use 16/32-byte shuffles where the target has
+// them and a bswap loop for the tail.
+
+inline void bswap_array32(void* dst, const void* src, size_t count)
+{
+  char* out = (char*)dst;
+  const char* in = (const char*)src;
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256i shuffle32_256 = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                                 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(in + i * 4));
+    _mm256_storeu_si256((__m256i*)(out + i * 4), _mm256_shuffle_epi8(v, shuffle32_256));
+  }
+#endif
+#if defined(__SSSE3__)
+  const __m128i shuffle32 = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)(in + i * 4));
+    _mm_storeu_si128((__m128i*)(out + i * 4), _mm_shuffle_epi8(v, shuffle32));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 4 <= count; i += 4)
+  {
+    uint8x16_t v = vld1q_u8((const uint8_t*)(in + i * 4));
+    vst1q_u8((uint8_t*)(out + i * 4), vrev32q_u8(v));
+  }
+#endif
+  for (; i < count; i++)
+  {
+    uint32_t x;
+    memcpy(&x, in + i * 4, 4);
+    x = bswap32(x);
+    memcpy(out + i * 4, &x, 4);
+  }
+}
+
+inline void bswap_array64(void* dst, const void* src, size_t count)
+{
+  char* out = (char*)dst;
+  const char* in = (const char*)src;
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256i shuffle64_256 = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                                 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  for (; i + 4 <= count; i += 4)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(in + i * 8));
+    _mm256_storeu_si256((__m256i*)(out + i * 8), _mm256_shuffle_epi8(v, shuffle64_256));
+  }
+#endif
+#if defined(__SSSE3__)
+  const __m128i shuffle64 = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  for (; i + 2 <= count; i += 2)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)(in + i * 8));
+    _mm_storeu_si128((__m128i*)(out + i * 8), _mm_shuffle_epi8(v, shuffle64));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 2 <= count; i += 2)
+  {
+    uint8x16_t v = vld1q_u8((const uint8_t*)(in + i * 8));
+    vst1q_u8((uint8_t*)(out + i * 8), vrev64q_u8(v));
+  }
+#endif
+  for (; i < count; i++)
+  {
+    uint64_t x;
+    memcpy(&x, in + i * 8, 8);
+    x = bswap64(x);
+    memcpy(out + i * 8, &x, 8);
+  }
+}
+
+inline void bswap_array16(void* dst, const void* src, size_t count)
+{
+  char* out = (char*)dst;
+  const char* in = (const char*)src;
+  for (size_t i = 0; i < count; i++)
+  {
+    uint16_t x;
+    memcpy(&x, in + i * 2, 2);
+    x = bswap16(x);
+    memcpy(out + i * 2, &x, 2);
+  }
+}
+
+// Array versions of store_le/load_le: a memcpy on little-endian hosts,
+// a vectorized swap on big-endian ones.
+template<typename T>
+inline void store_le_array(char* out, const T* values, size_t count)
+{
+  static_assert(std::is_arithmetic<T>::value, "store_le_array() takes arithmetic types");
+  if (!kHostIsBigEndian || sizeof(T) == 1)
+  {
+    if (count > 0) memcpy(out, values, count * sizeof(T));
+    return;
+  }
+  switch (sizeof(T))
+  {
+  case 2: bswap_array16(out, values, count); break;
+  case 4: bswap_array32(out, values, count); break;
+  case 8: bswap_array64(out, values, count); break;
+  }
+}
+
+template<typename T>
+inline void load_le_array(T* values, const char* in, size_t count)
+{
+  static_assert(std::is_arithmetic<T>::value, "load_le_array() takes arithmetic types");
+  if (!kHostIsBigEndian || sizeof(T) == 1)
+  {
+    if (count > 0) memcpy(values, in, count * sizeof(T));
+    return;
+  }
+  switch (sizeof(T))
+  {
+  case 2: bswap_array16(values, in, count); break;
+  case 4: bswap_array32(values, in, count); break;
+  case 8: bswap_array64(values, in, count); break;
+  }
+}